@@ -0,0 +1,45 @@
+#!/bin/sh
+# Throughput of the cat and tee builtins against the external commands
+# on a large file: file to file (copy_file_range), file to a pipe
+# (sendfile/splice) and a pipe fanned out by tee (tee/splice).
+# Usage: bench/cat_throughput.sh [megabytes]
+
+MB=${1:-2048}
+DATA=${TMPDIR:-/tmp}/oshell-bench.$$.dat
+OUT=${TMPDIR:-/tmp}/oshell-bench.$$.out
+OUT2=${TMPDIR:-/tmp}/oshell-bench.$$.out2
+
+cd "$(dirname "$0")/.." || exit 1
+[ -x ./oshell ] || make >/dev/null || exit 1
+
+now_ns() { date +%s%N; }
+
+trap 'rm -f "$DATA" "$OUT" "$OUT2"' EXIT
+head -c $((MB * 1024 * 1024)) /dev/urandom > "$DATA" || exit 1
+CAT=$(command -v cat)
+TEE=$(command -v tee)
+"$CAT" "$DATA" > "$OUT"      # Settle the page cache before measuring
+
+# MB/s for a command line run by oshell; "out" pipes its output on,
+# "in" feeds it the data through a pipe
+rate() {
+    rm -f "$OUT" "$OUT2"
+    sync
+    start=$(now_ns)
+    if [ "$2" = out ]; then
+        ./oshell -c "$1" | "$CAT" > /dev/null
+    elif [ "$2" = in ]; then
+        "$CAT" "$DATA" | ./oshell -c "$1"
+    else
+        ./oshell -c "$1"
+    fi
+    echo $(( MB * 1000000000 / ($(now_ns) - start) ))
+}
+
+echo "cat/tee over $MB MB:"
+printf '  %-22s builtin %6s MB/s   external %6s MB/s\n' "cat file > file" \
+    "$(rate "cat $DATA > $OUT")" "$(rate "$CAT $DATA > $OUT")"
+printf '  %-22s builtin %6s MB/s   external %6s MB/s\n' "cat file | ..." \
+    "$(rate "cat $DATA" out)" "$(rate "$CAT $DATA" out)"
+printf '  %-22s builtin %6s MB/s   external %6s MB/s\n' "... | tee f1 f2" \
+    "$(rate "tee $OUT $OUT2 > /dev/null" in)" "$(rate "$TEE $OUT $OUT2 > /dev/null" in)"
\ No newline at end of file
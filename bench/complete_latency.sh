@@ -0,0 +1,40 @@
+#!/bin/sh
+# Latency of command-name completion over a large PATH: the first
+# completion builds the trie, later ones only stat the directories and
+# walk it.
+# Usage: bench/complete_latency.sh [executables] [completions]
+
+N=${1:-20000}
+M=${2:-2000}
+DIR=${TMPDIR:-/tmp}/oshell-bench.$$.d
+SCRIPT=${TMPDIR:-/tmp}/oshell-bench.$$.sh
+
+cd "$(dirname "$0")/.." || exit 1
+[ -x ./oshell ] || make >/dev/null || exit 1
+
+now_ns() { date +%s%N; }
+
+trap 'rm -rf "$DIR" "$SCRIPT" "$SCRIPT.1"' EXIT
+mkdir -p "$DIR"
+(cd "$DIR" && seq -f 'cmd%05g' 0 $((N - 1)) | xargs touch && chmod +x cmd*)
+
+# Nanoseconds to run a script
+measure() {
+    start=$(now_ns)
+    ./oshell "$1" > /dev/null || return 1
+    echo $(( $(now_ns) - start ))
+}
+
+printf 'path %s\ncomplete cmd0000\n' "$DIR" > "$SCRIPT.1"
+cp "$SCRIPT.1" "$SCRIPT"
+i=0
+while [ $i -lt "$M" ]; do
+    printf 'complete cmd%04d\n' $((i % 2000)) >> "$SCRIPT"
+    i=$((i + 1))
+done
+
+first=$(measure "$SCRIPT.1")
+all=$(measure "$SCRIPT")
+echo "completion over $N executables:"
+printf '  first (builds the trie) %s us\n' $((first / 1000))
+printf '  afterwards              %s ns each\n' $(( (all - first) / M ))
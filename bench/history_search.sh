@@ -0,0 +1,40 @@
+#!/bin/sh
+# Latency of reverse history search over a large history file. The
+# first search maps the file, finds the line starts and builds the
+# trigram bitmaps; later ones only consult them.
+# Usage: bench/history_search.sh [entries] [searches]
+
+N=${1:-1000000}
+M=${2:-200}
+HIST=${TMPDIR:-/tmp}/oshell-bench.$$.hist
+SCRIPT=${TMPDIR:-/tmp}/oshell-bench.$$.sh
+
+cd "$(dirname "$0")/.." || exit 1
+[ -x ./oshell ] || make >/dev/null || exit 1
+
+now_ns() { date +%s%N; }
+
+trap 'rm -f "$HIST" "$SCRIPT" "$SCRIPT.1"' EXIT
+seq "$N" | awk '{ printf "git commit -m change-%d-done src/file%d.c\n", $1, $1 % 977 }' > "$HIST"
+
+# Nanoseconds to run a script
+measure() {
+    start=$(now_ns)
+    OSHELL_HISTFILE=$HIST ./oshell "$1" > /dev/null
+    echo $(( $(now_ns) - start ))
+}
+
+# Queries that match a single, old entry
+echo 'history -s change-12345-done' > "$SCRIPT.1"
+cp "$SCRIPT.1" "$SCRIPT"
+i=0
+while [ $i -lt "$M" ]; do
+    echo "history -s change-$((i * 7 + 1000))-done" >> "$SCRIPT"
+    i=$((i + 1))
+done
+
+first=$(measure "$SCRIPT.1")
+all=$(measure "$SCRIPT")
+echo "history search over $N entries:"
+printf '  first (indexes the file) %s us\n' $((first / 1000))
+printf '  afterwards               %s us each\n' $(( (all - first) / M / 1000 ))
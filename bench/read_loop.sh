@@ -0,0 +1,32 @@
+#!/bin/sh
+# Throughput of a `while read` loop over a large file: oshell's buffered
+# read against the byte-at-a-time read of other shells, where present.
+# Usage: bench/read_loop.sh [lines]
+
+N=${1:-10000000}
+DATA=${TMPDIR:-/tmp}/oshell-bench.$$.txt
+SCRIPT=${TMPDIR:-/tmp}/oshell-bench.$$.sh
+
+cd "$(dirname "$0")/.." || exit 1
+[ -x ./oshell ] || make >/dev/null || exit 1
+
+now_ns() { date +%s%N; }
+
+trap 'rm -f "$DATA" "$SCRIPT"' EXIT
+seq "$N" | sed 's/$/ some text/' > "$DATA"
+echo "while read -r n rest; do echo \$n; done < $DATA > /dev/null" > "$SCRIPT"
+
+# Nanoseconds per line for the given shell
+measure() {
+    start=$(now_ns)
+    "$@" "$SCRIPT" || return 1
+    echo $(( ($(now_ns) - start) / N ))
+}
+
+echo "while read over $N lines:"
+printf '  %-7s %s ns/line\n' oshell "$(measure ./oshell)"
+for sh in bash dash; do
+    if command -v $sh >/dev/null; then
+        printf '  %-7s %s ns/line\n' $sh "$(measure $sh)"
+    fi
+done
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Compare per-command latency of a cold oshell start with a request to a
+# warm oshell --server.  Usage: bench/server_latency.sh [iterations]
+
+N=${1:-1000}
+SOCK=${TMPDIR:-/tmp}/oshell-bench.$$
+SCRIPT=${TMPDIR:-/tmp}/oshell-bench.$$.sh
+CMD='echo ok'
+
+cd "$(dirname "$0")/.." || exit 1
+[ -x ./oshell ] && [ -x ./oshell-client ] || make >/dev/null || exit 1
+
+now_ns() { date +%s%N; }
+
+./oshell --server "$SOCK" &
+SERVER=$!
+trap 'kill $SERVER 2>/dev/null; rm -f "$SOCK" "$SCRIPT"' EXIT
+while [ ! -S "$SOCK" ]; do sleep 0.01; done
+echo "$CMD" > "$SCRIPT"
+
+start=$(now_ns)
+i=0
+while [ $i -lt "$N" ]; do
+    ./oshell "$SCRIPT" >/dev/null
+    i=$((i + 1))
+done
+cold=$(( ($(now_ns) - start) / N / 1000 ))
+
+start=$(now_ns)
+i=0
+while [ $i -lt "$N" ]; do
+    ./oshell-client "$SOCK" "$CMD" >/dev/null
+    i=$((i + 1))
+done
+warm=$(( ($(now_ns) - start) / N / 1000 ))
+
+echo "cold start:  ${cold} us/command"
+echo "warm server: ${warm} us/command"
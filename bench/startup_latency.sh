@@ -0,0 +1,31 @@
+#!/bin/sh
+# Measure per-invocation latency of `oshell -c` when the final command is
+# exec'd in place of the shell versus forked and waited for.
+# Usage: bench/startup_latency.sh [iterations]
+
+N=${1:-1000}
+
+cd "$(dirname "$0")/.." || exit 1
+[ -x ./oshell ] || make >/dev/null || exit 1
+
+now_ns() { date +%s%N; }
+
+# Average microseconds per run of the given command
+measure() {
+    start=$(now_ns)
+    i=0
+    while [ $i -lt "$N" ]; do
+        "$@" >/dev/null
+        i=$((i + 1))
+    done
+    echo $(( ($(now_ns) - start) / N / 1000 ))
+}
+
+# A trailing builtin keeps /bin/true from being the last command
+tail=$(measure ./oshell -c /bin/true)
+forked=$(measure ./oshell -c '/bin/true; echo -n')
+direct=$(measure /bin/true)
+
+echo "oshell -c, tail exec:  ${tail} us/run"
+echo "oshell -c, fork+wait:  ${forked} us/run"
+echo "/bin/true directly:    ${direct} us/run"
@@ -13,5 +13,23 @@ int builtin_setenv(command_t *cmd, shell_state_t *state);
 int builtin_unsetenv(command_t *cmd, shell_state_t *state);
 int builtin_alias(command_t *cmd, shell_state_t *state);
 int builtin_path(command_t *cmd, shell_state_t *state);
+int builtin_echo(command_t *cmd, shell_state_t *state);
+int builtin_pwd(command_t *cmd, shell_state_t *state);
+int builtin_jobs(command_t *cmd, shell_state_t *state);
+int builtin_stats(command_t *cmd, shell_state_t *state);
+int builtin_timeout(command_t *cmd, shell_state_t *state);
+int builtin_retry(command_t *cmd, shell_state_t *state);
+int builtin_cache(command_t *cmd, shell_state_t *state);
+int builtin_read(command_t *cmd, shell_state_t *state);
+int builtin_times(command_t *cmd, shell_state_t *state);
+int builtin_complete(command_t *cmd, shell_state_t *state);
+int builtin_history(command_t *cmd, shell_state_t *state);
+int builtin_enable(command_t *cmd, shell_state_t *state);
+int builtin_forall(command_t *cmd, shell_state_t *state);
+int builtin_coproc(command_t *cmd, shell_state_t *state);
+int builtin_cat(command_t *cmd, shell_state_t *state);
+int builtin_tee(command_t *cmd, shell_state_t *state);
+int builtin_source(command_t *cmd, shell_state_t *state);
+int builtin_exec(command_t *cmd, shell_state_t *state);
 
 #endif 
\ No newline at end of file
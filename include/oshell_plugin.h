@@ -0,0 +1,56 @@
+/* include/oshell_plugin.h - ABI for loadable builtins
+ *
+ * A plugin is a shared object defining, for each builtin it provides,
+ *
+ *     OSHELL_BUILTIN(name, function, "usage");
+ *
+ * which exports a descriptor named oshell_builtin_<name>. The shell
+ * loads it with `enable -f lib.so name...` and then runs the function
+ * in-process, like any other builtin: argv is the command's words after
+ * expansion (argv[0] is the name), ctx->out is its standard output with
+ * redirections applied, and the return value is its exit status.
+ *
+ * The ABI does not expose the shell's own structures. It changes only by
+ * adding fields at the end of oshell_ctx_t, which bumps
+ * OSHELL_PLUGIN_ABI; a plugin built against version N loads into any
+ * shell of version >= N.
+ */
+
+#ifndef OSHELL_PLUGIN_H
+#define OSHELL_PLUGIN_H
+
+#include <stdio.h>
+
+#define OSHELL_PLUGIN_ABI 1
+
+typedef struct oshell_ctx_s oshell_ctx_t;
+
+/* What a builtin gets to work with */
+struct oshell_ctx_s {
+    int abi_version;            /* Of the shell running the builtin */
+    FILE *out;                  /* Standard output */
+    FILE *err;                  /* Standard error */
+
+    /* Shell variable, else environment variable; NULL if unset */
+    const char *(*get_var)(oshell_ctx_t *ctx, const char *name);
+
+    /* Set a shell variable; 0 on success */
+    int (*set_var)(oshell_ctx_t *ctx, const char *name, const char *value);
+
+    void *shell;                /* Opaque to the plugin */
+};
+
+typedef int (*oshell_builtin_fn)(oshell_ctx_t *ctx, int argc, char **argv);
+
+typedef struct oshell_builtin_s {
+    int abi_version;            /* OSHELL_PLUGIN_ABI it was built with */
+    const char *name;
+    oshell_builtin_fn run;
+    const char *usage;
+} oshell_builtin_t;
+
+#define OSHELL_BUILTIN(name_, fn_, usage_) \
+    const oshell_builtin_t oshell_builtin_##name_ = \
+        { OSHELL_PLUGIN_ABI, #name_, fn_, usage_ }
+
+#endif
\ No newline at end of file
@@ -0,0 +1,17 @@
+/* include/server.h - Command-server wire protocol
+ *
+ * The client connects to the server's SOCK_SEQPACKET Unix socket and
+ * sends one request message carrying its stdin, stdout and stderr as
+ * SCM_RIGHTS descriptors, so output streams straight to the caller.
+ * The payload is a sequence of NUL-terminated strings: the working
+ * directory, the command line, then the environment as NAME=value.
+ * The server answers with one int32_t exit status.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#define SERVER_MAX_REQUEST (256 * 1024)
+#define SERVER_FD_COUNT 3
+
+#endif
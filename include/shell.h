@@ -3,11 +3,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <signal.h>
@@ -16,9 +18,11 @@
 /* Constants */
 #define MAX_INPUT 4096
 #define MAX_ARGS 128
+#define USER_FD_LIMIT 10           /* Scripts own fds 0-9; the shell's start here */
 #define MAX_PATH_LEN 4096
 #define MAX_ALIASES 100
 #define PROMPT "$ "
+#define HEREDOC_PROMPT "> "
 #define ERROR_MSG "An error has occurred\n"
 
 /* Shell modes */
@@ -38,15 +42,121 @@ typedef enum {
     OP_REDIRECT     /* > */
 } operator_t;
 
+/* Growable byte buffer */
+typedef struct buffer_s {
+    char *data;
+    size_t len;
+    size_t cap;
+} buffer_t;
+
+/* Redirection types */
+typedef enum {
+    REDIR_IN,           /* [n]<file */
+    REDIR_OUT,          /* [n]>file */
+    REDIR_APPEND,       /* [n]>>file */
+    REDIR_DUP,          /* [n]>&m, [n]<&m, [n]>&- */
+    REDIR_BOTH,         /* &>file */
+    REDIR_HEREDOC,      /* [n]<<WORD */
+    REDIR_HERESTRING    /* [n]<<<word */
+} redir_type_t;
+
+/* Single redirection, applied in list order */
+typedef struct redirect_s {
+    redir_type_t type;
+    int fd;                     /* Descriptor being redirected */
+    int target_fd;              /* Source descriptor for REDIR_DUP (-1: close) */
+    char *target;               /* File name, here-doc delimiter or word */
+    char *body;                 /* Here-document / here-string contents */
+    int quoted;                 /* Here-doc delimiter was quoted */
+    struct redirect_s *next;
+} redirect_t;
+
+/* Pipes carrying a background job's stdout/stderr to the output mux */
+typedef struct output_tap_s {
+    int read_fds[2];            /* Mux's ends, for fd 1 and fd 2 */
+    redirect_t redirs[2];       /* 1>&w and 2>&w, ahead of the command's own */
+} output_tap_t;
+
+/* Saved descriptors for undoing in-process redirections */
+#define MAX_SAVED_FDS 16
+typedef struct redir_save_s {
+    int count;
+    int fds[MAX_SAVED_FDS];     /* Descriptors that were redirected */
+    int saved[MAX_SAVED_FDS];   /* Their original targets (-1 if closed) */
+} redir_save_t;
+
+/* Process substitution: <(cmd) or >(cmd) used as an argument */
+typedef struct procsub_s {
+    int output;                 /* >(cmd): command writes into it */
+    char *text;                 /* Command text between the parentheses */
+    int arg_index;              /* Argument replaced by /dev/fd/N, or -1 */
+    redirect_t *redir;          /* Redirection whose target it is, if any */
+    int fd;                     /* Shell's end of the pipe */
+    pid_t pid;                  /* Child running the substitution */
+    struct procsub_s *next;
+} procsub_t;
+
 /* Command structure */
 typedef struct command_s {
     char **args;                /* Command arguments */
-    char *output_file;          /* For output redirection (>) */
+    redirect_t *redirs;         /* Redirections, in source order */
+    procsub_t *procsubs;        /* Process substitutions among args */
+    unsigned char *literal;     /* Per arg: single-quoted after a deferring builtin's --, or NULL */
     int background;             /* Run in background? */
     operator_t next_op;         /* Operator to next command */
     struct command_s *next;     /* Next command in chain */
 } command_t;
 
+/* Child process tracked by the shell */
+typedef struct job_s {
+    int id;                     /* Job number shown to the user */
+    pid_t pid;
+    char *command;              /* Command name for listings */
+    int background;             /* Started with & (counts toward the cap) */
+    int cpu;                    /* CPU it is pinned to, or -1 */
+    int status;                 /* Exit status, once done */
+    struct rusage usage;        /* What it used, once done */
+    struct job_s *next;
+} job_t;
+
+/* A builtin and its BUILTIN_* flags (see builtin_table in execute.c) */
+typedef struct builtin_s {
+    const char *name;
+    int flags;
+} builtin_t;
+
+#define BUILTIN_STATEFUL 0x01       /* Changes the shell itself: re-run on --resume */
+#define BUILTIN_DEFER_ARGS 0x02     /* Expands the words after its -- itself */
+
+/* Shell variable (not exported to the environment) */
+typedef struct shell_var_s {
+    char *name;
+    char *value;
+} shell_var_t;
+
+/* A script line as handed from the read-ahead thread to the executor */
+typedef struct input_line_s {
+    char *text;                 /* Line as read, without newline */
+    command_t *cmd;             /* Pre-parsed chain, or NULL to parse late */
+    char **heredoc_lines;       /* Raw lines consumed by its here-documents */
+    int heredoc_count;
+    int lineno;                 /* Line number in the batch file */
+    long parse_ns;              /* Time the reader spent parsing it */
+} input_line_t;
+
+/* Counters of the shell's own work (see metrics.c) */
+typedef struct shell_metrics_s {
+    long forks;                 /* fork() calls in the shell process */
+    long execs;                 /* External commands started */
+    long path_probes;           /* Candidate paths tried in path_dirs */
+    long prescan_hits;          /* Lookups answered by the prescan */
+    long parses;                /* Command lines parsed */
+    long parse_ns;              /* ...and the time that took */
+    long jobs_reaped;           /* Background jobs reaped */
+    long exit_status[256];      /* Foreground commands, by exit status */
+    long written_ns;            /* Last write of $OSHELL_METRICS_FILE */
+} shell_metrics_t;
+
 /* Shell state structure */
 typedef struct shell_state_s {
     shell_mode_t mode;
@@ -65,10 +175,91 @@ typedef struct shell_state_s {
     /* Path handling */
     char **path_dirs;
     int path_count;
+    long path_generation;       /* Bumped whenever path_dirs changes */
+    struct prescan_s *prescan;  /* Commands resolved ahead (--prescan) */
     
     /* Batch mode */
     char *batch_file;
     FILE *batch_fp;
+    
+    /* Lines read from the batch file so far */
+    int lineno;
+    
+    /* Dependency-graph mode (-j N): worker limit, 0 when off */
+    int dag_jobs;
+    
+    /* Checkpoint journal (--journal, --resume) */
+    struct journal_s *journal;
+    
+    /* Command string (-c), read like a batch file */
+    char *command_string;
+    
+    /* Last line of input: its final command may replace the shell */
+    int exec_tail;
+    
+    /* Stream builtins write to (swapped for in-process capture) */
+    FILE *out;
+    
+    /* Tracked child processes */
+    job_t *jobs;
+    job_t *done_jobs;           /* Finished background jobs `jobs` has yet to show */
+    int next_job_id;
+    pid_t last_bg_pid;
+    
+    /* Background job scheduling ($OSHELL_MAX_JOBS, $OSHELL_CPU_AFFINITY) */
+    long jobs_started;          /* Background jobs launched */
+    long jobs_queued;           /* ...of which had to wait for a slot */
+    int *cpus;                  /* CPUs the shell may run on */
+    long *cpu_assigned;         /* Jobs pinned to each, ever */
+    int cpu_count;
+    int next_cpu;               /* Round-robin cursor */
+    int spawn_cpu;              /* CPU for the command being spawned, or -1 */
+    
+    /* Runtime counters, for stats and $OSHELL_METRICS_FILE */
+    shell_metrics_t metrics;
+    
+    /* Resources used by reaped children, summed (max RSS: largest) */
+    struct rusage child_usage;
+    long children_reaped;
+    
+    /* Workers started by coproc */
+    struct coproc_s *coprocs;
+    
+    /* Files run by source, kept parsed */
+    struct source_cache_s *source_cache;
+    
+    /* Input buffered by the read builtin, per descriptor */
+    struct read_buffer_s *read_buffers;
+    
+    /* Command-name trie and directory listing for completion */
+    struct completer_s *completer;
+    
+    /* Command history, mapped from its file on first use */
+    struct history_s *history;
+    
+    /* Shell variables */
+    shell_var_t *vars;
+    int var_count;
+    int var_capacity;
+    
+    /* Pipelined batch mode: lines are read and parsed ahead on a thread */
+    int pipelined;
+    struct pipeline_s *pipeline;
+    
+    /* Tagged background output ($OSHELL_TAG_OUTPUT) */
+    struct outmux_s *outmux;
+    
+    /* Pre-forked spawn helper (--zygote) */
+    struct zygote_s *zygote;
+    unsigned exec_fds;          /* Bit n: fd n (3-9) opened by exec, which the zygote cannot pass */
+    
+    /* Command-server socket (--server) */
+    char *server_path;
+    
+    /* Lines already read ahead, served before any real input */
+    char **pending_lines;
+    int pending_count;
+    int pending_next;
 } shell_state_t;
 
 /* Function prototypes */
@@ -85,9 +276,14 @@ void free_command(command_t *cmd);
 
 /* execute.c functions */
 int execute_command(command_t *cmd, shell_state_t *state);
+int execute_chain(command_t *cmd, shell_state_t *state);
 int execute_builtin(command_t *cmd, shell_state_t *state);
 int execute_external(command_t *cmd, shell_state_t *state);
+pid_t spawn_external(command_t *cmd, shell_state_t *state);
+int exec_in_place(command_t *cmd, shell_state_t *state);
 int is_builtin(char *cmd);
+int builtin_flags(const char *cmd);
+extern const builtin_t builtin_table[];
 
 /* Built-in commands */
 int builtin_exit(command_t *cmd, shell_state_t *state);
@@ -97,6 +293,24 @@ int builtin_setenv(command_t *cmd, shell_state_t *state);
 int builtin_unsetenv(command_t *cmd, shell_state_t *state);
 int builtin_alias(command_t *cmd, shell_state_t *state);
 int builtin_path(command_t *cmd, shell_state_t *state);
+int builtin_echo(command_t *cmd, shell_state_t *state);
+int builtin_pwd(command_t *cmd, shell_state_t *state);
+int builtin_jobs(command_t *cmd, shell_state_t *state);
+int builtin_stats(command_t *cmd, shell_state_t *state);
+int builtin_timeout(command_t *cmd, shell_state_t *state);
+int builtin_retry(command_t *cmd, shell_state_t *state);
+int builtin_cache(command_t *cmd, shell_state_t *state);
+int builtin_read(command_t *cmd, shell_state_t *state);
+int builtin_times(command_t *cmd, shell_state_t *state);
+int builtin_complete(command_t *cmd, shell_state_t *state);
+int builtin_history(command_t *cmd, shell_state_t *state);
+int builtin_enable(command_t *cmd, shell_state_t *state);
+int builtin_forall(command_t *cmd, shell_state_t *state);
+int builtin_coproc(command_t *cmd, shell_state_t *state);
+int builtin_cat(command_t *cmd, shell_state_t *state);
+int builtin_tee(command_t *cmd, shell_state_t *state);
+int builtin_source(command_t *cmd, shell_state_t *state);
+int builtin_exec(command_t *cmd, shell_state_t *state);
 
 /* Utility functions */
 void print_error(void);
@@ -104,6 +318,8 @@ char **split_string(char *str, const char *delim, int *count);
 void free_string_array(char **array);
 char *trim_whitespace(char *str);
 char *my_strdup(const char *s);
+int move_fd_high(int fd);
+char *read_script_line(FILE *fp);
 
 /* Utility functions */
 void print_error(void);
@@ -112,9 +328,148 @@ void free_string_array(char **array);
 char *trim_whitespace(char *str);
 char *my_strdup(const char *s);
 
+/* Growable buffer */
+void buf_init(buffer_t *buf);
+int buf_reserve(buffer_t *buf, size_t extra);
+int buf_append(buffer_t *buf, const char *s, size_t len);
+char *buf_release(buffer_t *buf);
+void buf_free(buffer_t *buf);
+uint64_t hash_bytes(const char *data, size_t len);
+
 /* Variable expansion */
 char *expand_variables(char *arg, shell_state_t *state);  // ADD THIS LINE
 
+/* Redirection */
+int apply_redirections(redirect_t *redirs, redir_save_t *save);
+void restore_redirections(redir_save_t *save);
+void free_redirections(redirect_t *redirs);
+void collect_heredocs(command_t *cmd, shell_state_t *state);
+
+/* Pipelined batch execution */
+int parse_is_static(const char *text);
+char **scan_heredoc_delimiters(char *line, int *count);
+int pipeline_start(shell_state_t *state);
+input_line_t *pipeline_next(shell_state_t *state);
+int pipeline_at_end(shell_state_t *state);
+void pipeline_stop(shell_state_t *state);
+void free_input_line(input_line_t *line);
+void read_heredoc_lines(input_line_t *line, char *(*read_more)(void *), void *ctx);
+void set_errors_quiet(int quiet);
+
+/* Zygote spawner */
+int zygote_start(shell_state_t *state);
+pid_t zygote_spawn(shell_state_t *state, const char *path, char **argv);
+int zygote_owns(shell_state_t *state, pid_t pid);
+pid_t zygote_wait(shell_state_t *state, pid_t pid, int *status, int options,
+    struct rusage *usage);
+void zygote_poll(shell_state_t *state, int timeout_ms);
+
+/* usage.c functions */
+void usage_add(shell_state_t *state, const struct rusage *usage);
+void usage_set_last(shell_state_t *state, const struct rusage *usage);
+void usage_print(FILE *fp, const struct rusage *usage);
+int execute_timed(command_t *cmd, shell_state_t *state);
+
+/* read.c functions */
+void free_read_buffers(shell_state_t *state);
+
+/* loop.c functions */
+int loop_depth(const char *text);
+int starts_loop(const char *text);
+char *join_loop_lines(char *first, char *(*read_more)(void *), void *ctx);
+int run_loop(const char *text, shell_state_t *state);
+
+/* complete.c functions */
+int complete_line(shell_state_t *state, const char *line, size_t cursor,
+    size_t *word_start, char ***matches);
+void complete_free(shell_state_t *state);
+
+/* history.c functions */
+int history_count(shell_state_t *state);
+const char *history_get(shell_state_t *state, int i, size_t *len);
+void history_add(shell_state_t *state, const char *line);
+int history_search(shell_state_t *state, const char *query, int before);
+void history_free(shell_state_t *state);
+
+/* metrics.c functions */
+long metrics_now_ns(void);
+void metrics_add_parse(shell_state_t *state, long ns);
+void metrics_add_status(shell_state_t *state, int status);
+void metrics_print(shell_state_t *state, FILE *fp);
+void metrics_write(shell_state_t *state);
+void metrics_tick(shell_state_t *state);
+
+/* prescan.c functions */
+void prescan_script(shell_state_t *state);
+const char *prescan_lookup(shell_state_t *state, const char *name);
+void prescan_free(shell_state_t *state);
+
+/* source.c functions */
+void source_free(shell_state_t *state);
+
+/* coproc.c functions */
+void coproc_stop(shell_state_t *state);
+
+/* plugin.c functions */
+int is_plugin(const char *name);
+int run_plugin(command_t *cmd, shell_state_t *state);
+void free_plugins(void);
+const char *plugin_name(int index);
+long plugin_generation(void);
+
+/* lineedit.c functions */
+char *edit_line(shell_state_t *state, const char *prompt);
+
+/* dag.c functions */
+void run_dag(shell_state_t *state);
+
+/* journal.c functions */
+int journal_open(shell_state_t *state, const char *path, int resume);
+int journal_skip(shell_state_t *state, int lineno, const char *text);
+void journal_record(shell_state_t *state, int lineno, const char *text, int status);
+void journal_close(shell_state_t *state);
+
+/* outmux.c functions */
+int outmux_wanted(void);
+int outmux_tap(shell_state_t *state, command_t *cmd, output_tap_t *tap);
+void outmux_attach(shell_state_t *state, command_t *cmd, output_tap_t *tap,
+    int job_id, pid_t pid);
+void outmux_stop(shell_state_t *state);
+void zygote_stop(shell_state_t *state);
+
+/* Command server */
+void run_server(shell_state_t *state);
+
+/* Process substitution */
+int start_procsubs(command_t *cmd, shell_state_t *state);
+void close_procsub_fds(command_t *cmd);
+void wait_procsubs(command_t *cmd, shell_state_t *state);
+void free_procsubs(procsub_t *procsubs);
+
+/* Job table */
+job_t *job_add(shell_state_t *state, pid_t pid, const char *command);
+pid_t wait_child(shell_state_t *state, pid_t pid, int *status, int options);
+pid_t wait_child_usage(shell_state_t *state, pid_t pid, int *status, int options,
+    struct rusage *usage);
+int exit_code(int status);
+int job_wait(shell_state_t *state, pid_t pid);
+void jobs_reap(shell_state_t *state);
+void jobs_forget_done(shell_state_t *state);
+void job_throttle(shell_state_t *state);
+int job_pick_cpu(shell_state_t *state);
+int pin_to_cpu(pid_t pid, int cpu);
+void free_jobs(shell_state_t *state);
+
+/* Shell variables */
+const char *get_shell_var(shell_state_t *state, const char *name);
+int set_shell_var(shell_state_t *state, const char *name, const char *value);
+void unset_shell_var(shell_state_t *state, const char *name);
+void free_shell_vars(shell_state_t *state);
+
+/* Command substitution */
+char *skip_substitution(char *pos);
+char *command_substitute(const char *text, shell_state_t *state);
+
 /* Signal handling */
 void setup_signals(void);
 
@@ -124,5 +479,6 @@ void setup_signals(void);
 /* PATH handling */
 void init_path(shell_state_t *state);
 char *find_command_in_path(char *cmd, shell_state_t *state);
+void set_path(char **paths, int count, shell_state_t *state);
 
 #endif /* SHELL_H */
@@ -0,0 +1,54 @@
+/* plugins/basename.c - Sample loadable builtin
+ *
+ *     enable -f plugins/basename.so basename
+ *     basename PATH [SUFFIX]
+ *     basename -v VAR PATH [SUFFIX]
+ *
+ * Strips the directory part (and SUFFIX) from PATH without forking,
+ * printing the result or storing it in VAR.
+ */
+
+#include <string.h>
+#include "../include/oshell_plugin.h"
+
+static int run_basename(oshell_ctx_t *ctx, int argc, char **argv)
+{
+    const char *var = NULL;
+    int i = 1;
+
+    if (argc > 2 && strcmp(argv[1], "-v") == 0) {
+        var = argv[2];
+        i = 3;
+    }
+    if (argc - i < 1 || argc - i > 2) {
+        fprintf(ctx->err, "usage: basename [-v VAR] PATH [SUFFIX]\n");
+        return 2;
+    }
+
+    /* Trailing slashes do not count; "/" stays "/" */
+    const char *path = argv[i];
+    size_t end = strlen(path);
+    while (end > 1 && path[end - 1] == '/') end--;
+    size_t start = end;
+    while (start > 0 && path[start - 1] != '/') start--;
+    if (start == end && end > 0) start = end - 1;
+
+    const char *suffix = argv[i + 1];
+    if (suffix != NULL) {
+        size_t n = strlen(suffix);
+        if (n < end - start && strncmp(path + end - n, suffix, n) == 0) end -= n;
+    }
+
+    char name[4096];
+    size_t len = end - start < sizeof(name) ? end - start : sizeof(name) - 1;
+    memcpy(name, path + start, len);
+    name[len] = '\0';
+
+    if (var != NULL) {
+        return ctx->set_var(ctx, var, name) == 0 ? 0 : 1;
+    }
+    fprintf(ctx->out, "%s\n", name);
+    return 0;
+}
+
+OSHELL_BUILTIN(basename, run_basename, "basename [-v VAR] PATH [SUFFIX]");
\ No newline at end of file
@@ -36,12 +36,11 @@ int builtin_cd(command_t *cmd, shell_state_t *state)
 int builtin_env(command_t *cmd, shell_state_t *state)
 {
     (void)cmd; /* Unused parameter */
-    (void)state; /* Unused parameter */
     
     /* Print environment variables */
     extern char **environ;
     for (char **env = environ; *env != NULL; env++) {
-        printf("%s\n", *env);
+        fprintf(state->out, "%s\n", *env);
     }
     return 0;
 }
@@ -106,6 +105,7 @@ int builtin_path(command_t *cmd, shell_state_t *state)
         free(state->path_dirs);
         state->path_dirs = NULL;
         state->path_count = 0;
+        state->path_generation++;
     }
     
     /* If no arguments, clear PATH */
@@ -132,8 +132,97 @@ int builtin_path(command_t *cmd, shell_state_t *state)
         return 1;
     }
     
-    /* Reinitialize shell's path directories */
-    init_path(state);
+    /* Search the named directories from now on */
+    int count = 0;
+    while (cmd->args[count + 1] != NULL) count++;
+    set_path(cmd->args + 1, count, state);
+    
+    return 0;
+}
+
+/* Built-in: echo */
+int builtin_echo(command_t *cmd, shell_state_t *state)
+{
+    int i = 1;
+    int newline = 1;
+    
+    if (cmd->args[1] != NULL && strcmp(cmd->args[1], "-n") == 0) {
+        newline = 0;
+        i++;
+    }
+    
+    for (int first = i; cmd->args[i] != NULL; i++) {
+        if (i > first) fputc(' ', state->out);
+        fputs(cmd->args[i], state->out);
+    }
+    if (newline) fputc('\n', state->out);
+    
+    return 0;
+}
+
+/* Built-in: pwd */
+int builtin_pwd(command_t *cmd, shell_state_t *state)
+{
+    (void)cmd; /* Unused parameter */
+    
+    fprintf(state->out, "%s\n", state->cwd);
+    return 0;
+}
+
+/* Built-in: jobs */
+int builtin_jobs(command_t *cmd, shell_state_t *state)
+{
+    (void)cmd; /* Unused parameter */
+    
+    jobs_reap(state);
+    for (job_t *job = state->jobs; job != NULL; job = job->next) {
+        fprintf(state->out, "[%d] %d Running %s\n", job->id, (int)job->pid,
+            job->command);
+    }
+    
+    /* Finished since the last listing, with what each used */
+    for (job_t *job = state->done_jobs; job != NULL; job = job->next) {
+        if (job->status == 0) {
+            fprintf(state->out, "[%d] %d Done %s (", job->id, (int)job->pid, job->command);
+        } else {
+            fprintf(state->out, "[%d] %d Exit %d %s (", job->id, (int)job->pid,
+                job->status, job->command);
+        }
+        usage_print(state->out, &job->usage);
+        fprintf(state->out, ")\n");
+    }
+    jobs_forget_done(state);
+    return 0;
+}
+
+/* Built-in: stats - background job queue and CPU assignment */
+int builtin_stats(command_t *cmd, shell_state_t *state)
+{
+    (void)cmd; /* Unused parameter */
+    
+    const char *limit = getenv("OSHELL_MAX_JOBS");
+    const char *policy = getenv("OSHELL_CPU_AFFINITY");
+    int running = 0;
+    
+    jobs_reap(state);
+    for (job_t *job = state->jobs; job != NULL; job = job->next) {
+        if (job->background) running++;
+    }
+    
+    fprintf(state->out, "jobs: %d running, limit %s, %ld started, %ld queued\n",
+        running, limit && atoi(limit) > 0 ? limit : "none",
+        state->jobs_started, state->jobs_queued);
+    fprintf(state->out, "affinity: %s\n", policy && *policy ? policy : "off");
+    
+    for (int i = 0; i < state->cpu_count; i++) {
+        int load = 0;
+        for (job_t *job = state->jobs; job != NULL; job = job->next) {
+            if (job->cpu == state->cpus[i]) load++;
+        }
+        fprintf(state->out, "cpu %d: %d running, %ld assigned\n",
+            state->cpus[i], load, state->cpu_assigned[i]);
+    }
     
+    metrics_print(state, state->out);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,396 @@
+/* src/cache.c - cache builtin: replay output of repeatable commands
+ *
+ * cache [--key-file F]... [--env VAR]... -- command [args...]
+ *
+ * The key covers the working directory, argv, the named environment
+ * variables and the size and mtime of each key file. Each entry is a
+ * directory named by the key's 64-bit FNV-1a hash holding the full key
+ * (to rule out collisions), the command's stdout and stderr and its exit
+ * status. Entries live in $OSHELL_CACHE_DIR (default ~/.cache/oshell);
+ * once the store exceeds $OSHELL_CACHE_MAX bytes (default 100M) the
+ * least recently used entries are evicted, by directory mtime.
+ */
+
+#include "../include/shell.h"
+#include <dirent.h>
+#include <limits.h>
+#include <sys/time.h>
+
+#define CACHE_DEFAULT_MAX (100L * 1024 * 1024)
+
+/* Files in an entry */
+static const char *const entry_files[] = { "key", "out", "err", "status" };
+#define ENTRY_FILE_COUNT 4
+
+/* Append a NUL-terminated field to the key */
+static void key_field(buffer_t *key, const char *tag, const char *value)
+{
+    buf_append(key, tag, strlen(tag));
+    buf_append(key, value, strlen(value) + 1);
+}
+
+/* dir/name into buf; -1 if it does not fit */
+static int join_path(char *buf, size_t size, const char *dir, const char *name)
+{
+    int n = snprintf(buf, size, "%s/%s", dir, name);
+    return n < 0 || (size_t)n >= size ? -1 : 0;
+}
+
+/* Store location, created on first use; NULL if unusable */
+static char *cache_dir(void)
+{
+    const char *dir = getenv("OSHELL_CACHE_DIR");
+    char path[PATH_MAX];
+
+    if (dir != NULL && *dir != '\0') {
+        snprintf(path, sizeof(path), "%s", dir);
+    } else if ((dir = getenv("XDG_CACHE_HOME")) != NULL && *dir != '\0') {
+        join_path(path, sizeof(path), dir, "oshell");
+    } else if ((dir = getenv("HOME")) != NULL) {
+        snprintf(path, sizeof(path), "%s/.cache/oshell", dir);
+    } else {
+        return NULL;
+    }
+
+    /* mkdir -p */
+    for (char *slash = path + 1; ; slash++) {
+        if (*slash == '/' || *slash == '\0') {
+            char saved = *slash;
+            *slash = '\0';
+            if (mkdir(path, 0700) != 0 && errno != EEXIST) return NULL;
+            *slash = saved;
+            if (saved == '\0') break;
+        }
+    }
+    return my_strdup(path);
+}
+
+/* Size limit from $OSHELL_CACHE_MAX, with an optional K/M/G suffix */
+static long cache_limit(void)
+{
+    const char *value = getenv("OSHELL_CACHE_MAX");
+    char *end;
+
+    if (value == NULL || *value == '\0') return CACHE_DEFAULT_MAX;
+
+    long limit = strtol(value, &end, 10);
+    switch (*end) {
+        case 'G': case 'g': limit *= 1024; /* fall through */
+        case 'M': case 'm': limit *= 1024; /* fall through */
+        case 'K': case 'k': limit *= 1024; break;
+        default: break;
+    }
+    return limit > 0 ? limit : CACHE_DEFAULT_MAX;
+}
+
+/* Read a whole file into a buffer; -1 if it cannot be opened */
+static int read_file(const char *path, buffer_t *out)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    buf_init(out);
+    for (;;) {
+        if (buf_reserve(out, 64 * 1024) != 0) break;
+        ssize_t n = read(fd, out->data + out->len, out->cap - out->len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        out->len += n;
+    }
+    close(fd);
+    return 0;
+}
+
+/* Copy a file to fd */
+static void replay_file(const char *path, int fd)
+{
+    char buffer[64 * 1024];
+    int in = open(path, O_RDONLY | O_CLOEXEC);
+    if (in < 0) return;
+
+    ssize_t n;
+    while ((n = read(in, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t w = write(fd, buffer + done, n - done);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                close(in);
+                return;
+            }
+            done += w;
+        }
+    }
+    close(in);
+}
+
+/* Remove an entry directory and its files */
+static void remove_entry(const char *entry)
+{
+    char path[PATH_MAX];
+
+    for (int i = 0; i < ENTRY_FILE_COUNT; i++) {
+        join_path(path, sizeof(path), entry, entry_files[i]);
+        unlink(path);
+    }
+    rmdir(entry);
+}
+
+/* Entry seen while enforcing the size limit */
+typedef struct cache_entry_s {
+    char *path;
+    long long used;             /* mtime in ns */
+    long size;
+} cache_entry_t;
+
+/* Oldest use first */
+static int compare_used(const void *a, const void *b)
+{
+    const cache_entry_t *x = a;
+    const cache_entry_t *y = b;
+    return (x->used > y->used) - (x->used < y->used);
+}
+
+/* Evict least recently used entries until the store fits its limit */
+static void cache_evict(const char *dir, long limit)
+{
+    DIR *d = opendir(dir);
+    if (d == NULL) return;
+
+    cache_entry_t *entries = NULL;
+    int count = 0;
+    int capacity = 0;
+    long total = 0;
+    struct dirent *de;
+
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.') continue; /* Also in-progress entries */
+
+        char entry[PATH_MAX];
+        struct stat st;
+        join_path(entry, sizeof(entry), dir, de->d_name);
+        if (stat(entry, &st) != 0 || !S_ISDIR(st.st_mode)) continue;
+
+        long size = 0;
+        for (int i = 0; i < ENTRY_FILE_COUNT; i++) {
+            char path[PATH_MAX];
+            struct stat fst;
+            join_path(path, sizeof(path), entry, entry_files[i]);
+            if (stat(path, &fst) == 0) size += fst.st_size;
+        }
+
+        if (count >= capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            cache_entry_t *grown = realloc(entries, capacity * sizeof(cache_entry_t));
+            if (grown == NULL) break;
+            entries = grown;
+        }
+        entries[count].path = my_strdup(entry);
+        entries[count].used = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        entries[count].size = size;
+        count++;
+        total += size;
+    }
+    closedir(d);
+
+    if (total > limit) {
+        qsort(entries, count, sizeof(cache_entry_t), compare_used);
+        for (int i = 0; i < count && total > limit; i++) {
+            remove_entry(entries[i].path);
+            total -= entries[i].size;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        free(entries[i].path);
+    }
+    free(entries);
+}
+
+/* Run the command with stdout and stderr captured into tmp, and
+ * return its status */
+static int run_and_record(command_t *sub, shell_state_t *state, const char *tmp)
+{
+    char path[PATH_MAX];
+    int fds[2];
+
+    for (int i = 0; i < 2; i++) {
+        join_path(path, sizeof(path), tmp, entry_files[i + 1]);
+        fds[i] = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    }
+    if (fds[0] < 0 || fds[1] < 0) {
+        if (fds[0] >= 0) close(fds[0]);
+        if (fds[1] >= 0) close(fds[1]);
+        return -1;
+    }
+
+    /* 1>&out 2>&err */
+    redirect_t redirs[2];
+    memset(redirs, 0, sizeof(redirs));
+    for (int i = 0; i < 2; i++) {
+        redirs[i].type = REDIR_DUP;
+        redirs[i].fd = STDOUT_FILENO + i;
+        redirs[i].target_fd = fds[i];
+    }
+    redirs[0].next = &redirs[1];
+    sub->redirs = redirs;
+
+    int status;
+    if (is_builtin(sub->args[0])) {
+        status = execute_builtin(sub, state);
+    } else {
+        status = execute_external(sub, state);
+    }
+    sub->redirs = NULL;
+
+    close(fds[0]);
+    close(fds[1]);
+    return status;
+}
+
+/* Built-in: cache [--key-file F]... [--env VAR]... -- command [args...] */
+int builtin_cache(command_t *cmd, shell_state_t *state)
+{
+    buffer_t key;
+    int i = 1;
+
+    buf_init(&key);
+    key_field(&key, "cwd ", state->cwd);
+
+    for (; cmd->args[i] != NULL; i++) {
+        char *opt = cmd->args[i];
+        if (strcmp(opt, "--") == 0) {
+            i++;
+            break;
+        }
+        if (strcmp(opt, "--key-file") != 0 && strcmp(opt, "--env") != 0) {
+            break;
+        }
+        char *value = cmd->args[++i];
+        if (value == NULL) break;
+
+        if (strcmp(opt, "--env") == 0) {
+            char *env = getenv(value);
+            key_field(&key, "env ", value);
+            key_field(&key, env ? "= " : "unset ", env ? env : "");
+        } else {
+            struct stat st;
+            char meta[64] = "missing";
+            if (stat(value, &st) == 0) {
+                snprintf(meta, sizeof(meta), "%lld %lld.%09ld",
+                    (long long)st.st_size, (long long)st.st_mtim.tv_sec,
+                    st.st_mtim.tv_nsec);
+            }
+            key_field(&key, "file ", value);
+            key_field(&key, "stat ", meta);
+        }
+    }
+
+    if (cmd->args[i] == NULL) {
+        buf_free(&key);
+        fprintf(stderr, "cache: usage: cache [--key-file F]... [--env VAR]... -- command [args...]\n");
+        return 1;
+    }
+
+    command_t sub;
+    memset(&sub, 0, sizeof(sub));
+    sub.args = cmd->args + i;
+    sub.next_op = OP_NONE;
+    for (; cmd->args[i] != NULL; i++) {
+        key_field(&key, "arg ", cmd->args[i]);
+    }
+
+    /* The command must come back to the shell to be recorded */
+    int exec_tail = state->exec_tail;
+    state->exec_tail = 0;
+
+    char *dir = cache_dir();
+    if (dir == NULL) {
+        buf_free(&key);
+        int status = is_builtin(sub.args[0]) ? execute_builtin(&sub, state)
+            : execute_external(&sub, state);
+        state->exec_tail = exec_tail;
+        return status;
+    }
+
+    char entry[PATH_MAX];
+    char path[PATH_MAX];
+    snprintf(entry, sizeof(entry), "%s/%016llx", dir,
+        (unsigned long long)hash_bytes(key.data, key.len));
+
+    /* Hit: the stored key must match exactly */
+    buffer_t stored;
+    join_path(path, sizeof(path), entry, "key");
+    if (read_file(path, &stored) == 0) {
+        int hit = stored.len == key.len && memcmp(stored.data, key.data, key.len) == 0;
+        buf_free(&stored);
+
+        buffer_t status_text;
+        join_path(path, sizeof(path), entry, "status");
+        if (hit && read_file(path, &status_text) == 0) {
+            buf_append(&status_text, "", 1);
+            int status = atoi(status_text.data);
+            buf_free(&status_text);
+
+            fflush(stdout);
+            join_path(path, sizeof(path), entry, "out");
+            replay_file(path, STDOUT_FILENO);
+            join_path(path, sizeof(path), entry, "err");
+            replay_file(path, STDERR_FILENO);
+
+            /* Mark as recently used */
+            utimes(entry, NULL);
+
+            buf_free(&key);
+            free(dir);
+            state->exec_tail = exec_tail;
+            return status;
+        }
+    }
+
+    /* Miss: record into a private directory, then publish it whole */
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s/.tmp.XXXXXX", dir);
+    int have_tmp = mkdtemp(tmp) != NULL;
+    int status = have_tmp ? run_and_record(&sub, state, tmp) : -1;
+
+    if (status >= 0) {
+        FILE *fp;
+        join_path(path, sizeof(path), tmp, "key");
+        if ((fp = fopen(path, "w")) != NULL) {
+            fwrite(key.data, 1, key.len, fp);
+            fclose(fp);
+        }
+        join_path(path, sizeof(path), tmp, "status");
+        if ((fp = fopen(path, "w")) != NULL) {
+            fprintf(fp, "%d\n", status);
+            fclose(fp);
+        }
+
+        fflush(stdout);
+        join_path(path, sizeof(path), tmp, "out");
+        replay_file(path, STDOUT_FILENO);
+        join_path(path, sizeof(path), tmp, "err");
+        replay_file(path, STDERR_FILENO);
+
+        /* A command that could not be started is not worth keeping */
+        if (status == 126 || status == 127) {
+            remove_entry(tmp);
+        } else {
+            remove_entry(entry);
+            if (rename(tmp, entry) != 0) {
+                remove_entry(tmp);
+            }
+            cache_evict(dir, cache_limit());
+        }
+    } else {
+        /* Store unusable: just run the command */
+        if (have_tmp) remove_entry(tmp);
+        status = is_builtin(sub.args[0]) ? execute_builtin(&sub, state)
+            : execute_external(&sub, state);
+    }
+
+    buf_free(&key);
+    free(dir);
+    state->exec_tail = exec_tail;
+    return status;
+}
\ No newline at end of file
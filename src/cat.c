@@ -0,0 +1,341 @@
+/* src/cat.c - cat and tee builtins that copy inside the kernel
+ *
+ *     cat [-u] [FILE...]     FILE "-" (or none) is stdin
+ *     tee [-a] [FILE...]
+ *
+ * Both run in-process on the fds execute_builtin() has already
+ * redirected. cat moves each file to stdout with copy_file_range()
+ * (file to file), sendfile() (from a file) or splice() (to or from a
+ * pipe), so the data never passes through a user-space buffer; tee
+ * duplicates a pipe on stdin into each output with tee() and splice().
+ * Whatever the kernel refuses for a pair of fds is copied with large
+ * read()/write() calls instead, and when output is being captured (a
+ * $(...) substitution) it goes through state->out. Other cat options
+ * are left to the cat in PATH.
+ */
+
+#include "../include/shell.h"
+#include <sys/sendfile.h>
+
+#define COPY_CHUNK (1 << 30)        /* Per zero-copy call */
+#define COPY_BUFFER (128 * 1024)    /* Per read() when falling back */
+#define TEE_PIPE_SIZE (1 << 20)
+
+/* Errors that mean "not for these fds": try the next method */
+static int unsupported(int err)
+{
+    return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP ||
+        err == EBADF;
+}
+
+/* Write all of buf to fd */
+static int write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Copy in to out until EOF through a buffer; out is a stream if
+ * stream is not NULL */
+static int copy_buffered(int in, int out, FILE *stream)
+{
+    char *buf = malloc(COPY_BUFFER);
+    if (buf == NULL) return -1;
+
+    int result = 0;
+    for (;;) {
+        ssize_t n = read(in, buf, COPY_BUFFER);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            result = n < 0 ? -1 : 0;
+            break;
+        }
+        if (stream != NULL ? fwrite(buf, 1, n, stream) != (size_t)n :
+            write_all(out, buf, n) != 0) {
+            result = -1;
+            break;
+        }
+    }
+    free(buf);
+    return result;
+}
+
+/* Copy in to out until EOF, by the cheapest method the pair allows.
+ * Each method continues from the file positions the last one left */
+static int copy_fd(int in, int out)
+{
+    struct stat in_st;
+    struct stat out_st;
+    ssize_t n;
+
+    if (fstat(in, &in_st) != 0 || fstat(out, &out_st) != 0) return -1;
+
+    if (S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode)) {
+        do {
+            n = copy_file_range(in, NULL, out, NULL, COPY_CHUNK, 0);
+        } while (n > 0 || (n < 0 && errno == EINTR));
+        if (n == 0) return 0;
+        if (!unsupported(errno)) return -1;
+    }
+
+    if (S_ISREG(in_st.st_mode) || S_ISBLK(in_st.st_mode)) {
+        do {
+            n = sendfile(out, in, NULL, COPY_CHUNK);
+        } while (n > 0 || (n < 0 && errno == EINTR));
+        if (n == 0) return 0;
+        if (!unsupported(errno)) return -1;
+    }
+
+    if (S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode)) {
+        do {
+            n = splice(in, NULL, out, NULL, COPY_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+        } while (n > 0 || (n < 0 && errno == EINTR));
+        if (n == 0) return 0;
+        if (!unsupported(errno)) return -1;
+    }
+
+    return copy_buffered(in, out, NULL);
+}
+
+/* Copy in to the builtin's output */
+static int copy_to_output(shell_state_t *state, int in)
+{
+    if (state->out != stdout) {
+        return copy_buffered(in, -1, state->out);
+    }
+    fflush(stdout);
+    return copy_fd(in, STDOUT_FILENO);
+}
+
+/* Would copying in to stdout read back what it writes (cat f >> f)?
+ * As GNU cat: the same regular file, with data left to read */
+static int is_output_file(int in)
+{
+    struct stat in_st;
+    struct stat out_st;
+
+    if (fstat(in, &in_st) != 0 || fstat(STDOUT_FILENO, &out_st) != 0) return 0;
+    if (!S_ISREG(in_st.st_mode) || !S_ISREG(out_st.st_mode) ||
+        in_st.st_dev != out_st.st_dev || in_st.st_ino != out_st.st_ino) {
+        return 0;
+    }
+    off_t offset = lseek(in, 0, SEEK_CUR);
+    return offset >= 0 && offset < in_st.st_size;
+}
+
+/* Copy one input to the builtin's output; name is for messages */
+static int cat_one(shell_state_t *state, int fd, const char *name)
+{
+    if (state->out == stdout && is_output_file(fd)) {
+        fprintf(stderr, "cat: %s: input file is output file\n", name);
+        return 1;
+    }
+    if (copy_to_output(state, fd) != 0) {
+        fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+/* Run the cat found in PATH, for the options the builtin lacks. The
+ * redirections are already in place */
+static int external_cat(command_t *cmd, shell_state_t *state)
+{
+    command_t sub;
+    memset(&sub, 0, sizeof(sub));
+    sub.args = cmd->args;
+    sub.next_op = OP_NONE;
+
+    /* It has to come back here to undo the redirections */
+    int exec_tail = state->exec_tail;
+    state->exec_tail = 0;
+    fflush(state->out);
+    int status = execute_external(&sub, state);
+    state->exec_tail = exec_tail;
+    return status;
+}
+
+/* Built-in: cat [-u] [--] [FILE...] */
+int builtin_cat(command_t *cmd, shell_state_t *state)
+{
+    int status = 0;
+    int i = 1;
+
+    /* Any option but -u (ignored: output is never buffered) is the
+     * external cat's, wherever it appears before -- */
+    for (int k = 1; cmd->args[k] != NULL && strcmp(cmd->args[k], "--") != 0; k++) {
+        if (cmd->args[k][0] == '-' && cmd->args[k][1] != '\0' &&
+            strcmp(cmd->args[k], "-u") != 0) {
+            return external_cat(cmd, state);
+        }
+    }
+
+    int files = 0;
+    int options = 1;
+    for (; cmd->args[i] != NULL; i++) {
+        const char *file = cmd->args[i];
+
+        if (options && strcmp(file, "-u") == 0) continue;
+        if (options && strcmp(file, "--") == 0) {
+            options = 0;
+            continue;
+        }
+        files++;
+        if (strcmp(file, "-") == 0) {
+            status |= cat_one(state, STDIN_FILENO, file);
+            continue;
+        }
+
+        int fd = open(file, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "cat: %s: %s\n", file, strerror(errno));
+            status = 1;
+            continue;
+        }
+        status |= cat_one(state, fd, file);
+        close(fd);
+    }
+
+    if (files == 0) {
+        status = cat_one(state, STDIN_FILENO, "-");
+    }
+    return status;
+}
+
+/* Move exactly len bytes from pipe in to out: splice() or, if out will
+ * not take it, read() and write() */
+static int move_bytes(int in, int out, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = splice(in, NULL, out, NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && unsupported(errno)) {
+            char buf[65536];
+            n = read(in, buf, len < sizeof(buf) ? len : sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            if (n > 0 && write_all(out, buf, n) != 0) return -1;
+        }
+        if (n <= 0) return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+/* tee() a pipe on stdin into every output. Returns 1 if stdin is not a
+ * pipe tee() accepts (nothing consumed), 0 at EOF, -1 on error */
+static int tee_spliced(int *outs, int count)
+{
+    int mid[2];
+
+    if (pipe2(mid, O_CLOEXEC) != 0) return 1;
+
+    /* Fewer, larger rounds: let both pipes hold 1M (best effort) */
+    fcntl(mid[1], F_SETPIPE_SZ, TEE_PIPE_SIZE);
+    fcntl(STDIN_FILENO, F_SETPIPE_SZ, TEE_PIPE_SIZE);
+
+    int result = 0;
+    int first = 1;
+    for (;;) {
+        /* Copy what is in the pipe to each output but the last through
+         * mid, then move it to the last */
+        ssize_t len = count > 1 ? tee(STDIN_FILENO, mid[1], COPY_CHUNK, 0) :
+            splice(STDIN_FILENO, NULL, outs[0], NULL, COPY_CHUNK,
+                SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (len < 0 && errno == EINTR) continue;
+        if (len < 0) result = first && unsupported(errno) ? 1 : -1;
+        if (len <= 0) break;
+        first = 0;
+        if (count == 1) continue;
+
+        for (int i = 0; i < count - 1 && result == 0; i++) {
+            ssize_t n = len;
+            if (i > 0) {
+                do {
+                    n = tee(STDIN_FILENO, mid[1], len, 0);
+                } while (n < 0 && errno == EINTR);
+            }
+            if (n != len || move_bytes(mid[0], outs[i], len) != 0) result = -1;
+        }
+        if (result == 0 && move_bytes(STDIN_FILENO, outs[count - 1], len) != 0) {
+            result = -1;
+        }
+        if (result != 0) break;
+    }
+
+    close(mid[0]);
+    close(mid[1]);
+    return result;
+}
+
+/* Built-in: tee [-a] [FILE...] */
+int builtin_tee(command_t *cmd, shell_state_t *state)
+{
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    int outs[MAX_ARGS];
+    int count = 0;
+    int status = 0;
+    int i = 1;
+
+    if (cmd->args[i] != NULL && strcmp(cmd->args[i], "-a") == 0) {
+        flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+        i++;
+    }
+
+    /* stdout first, then the files in order */
+    int captured = state->out != stdout;
+    if (!captured) {
+        fflush(stdout);
+        outs[count++] = STDOUT_FILENO;
+    }
+    for (; cmd->args[i] != NULL; i++) {
+        int fd = open(cmd->args[i], flags, 0666);
+        if (fd < 0) {
+            fprintf(stderr, "tee: %s: %s\n", cmd->args[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        outs[count++] = fd;
+    }
+
+    int result = 1;
+    struct stat st;
+    if (!captured && count > 0 && fstat(STDIN_FILENO, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        result = tee_spliced(outs, count);
+    }
+
+    /* Not a pipe (or captured): read once, write to each */
+    if (result == 1) {
+        char *buf = malloc(COPY_BUFFER);
+        result = buf != NULL ? 0 : -1;
+        while (buf != NULL) {
+            ssize_t n = read(STDIN_FILENO, buf, COPY_BUFFER);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                if (n < 0) result = -1;
+                break;
+            }
+            if (captured && fwrite(buf, 1, n, state->out) != (size_t)n) result = -1;
+            for (int k = 0; k < count; k++) {
+                if (write_all(outs[k], buf, n) != 0) result = -1;
+            }
+        }
+        free(buf);
+    }
+    if (result != 0) {
+        fprintf(stderr, "tee: %s\n", strerror(errno));
+        status = 1;
+    }
+
+    for (int k = 0; k < count; k++) {
+        if (outs[k] != STDOUT_FILENO) close(outs[k]);
+    }
+    return status;
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+/* src/client.c - Minimal client for oshell --server
+ *
+ * Usage: oshell-client SOCKET COMMAND
+ * Runs COMMAND in the server with this process's cwd, environment and
+ * stdio, and exits with the command's status.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../include/server.h"
+
+extern char **environ;
+
+/* Append a NUL-terminated string to the request */
+static int append(char *buf, size_t *len, const char *s)
+{
+    size_t n = strlen(s) + 1;
+    if (*len + n > SERVER_MAX_REQUEST) return -1;
+    memcpy(buf + *len, s, n);
+    *len += n;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static char request[SERVER_MAX_REQUEST];
+    size_t len = 0;
+    char cwd[4096];
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s SOCKET COMMAND\n", argv[0]);
+        return 2;
+    }
+
+    if (getcwd(cwd, sizeof(cwd)) == NULL ||
+        append(request, &len, cwd) != 0 ||
+        append(request, &len, argv[2]) != 0) {
+        fprintf(stderr, "An error has occurred\n");
+        return 1;
+    }
+    /* Running with part of the environment would be worse than not at all */
+    for (char **env = environ; *env != NULL; env++) {
+        if (append(request, &len, *env) != 0) {
+            fprintf(stderr, "%s: environment too large (over %d bytes)\n",
+                argv[0], SERVER_MAX_REQUEST);
+            return 1;
+        }
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(argv[1]) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "An error has occurred\n");
+        return 1;
+    }
+    strcpy(addr.sun_path, argv[1]);
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("connect");
+        return 1;
+    }
+
+    /* Pass stdin, stdout and stderr along with the request */
+    int fds[SERVER_FD_COUNT] = { 0, 1, 2 };
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = { request, len };
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(sock, &msg, 0) < 0) {
+        perror("sendmsg");
+        return 1;
+    }
+
+    int32_t status;
+    if (read(sock, &status, sizeof(status)) != sizeof(status)) {
+        return 1;
+    }
+    return status;
+}
\ No newline at end of file
@@ -0,0 +1,449 @@
+/* src/complete.c - Command and file name completion
+ *
+ * Command names come from a prefix trie holding the builtins (loaded
+ * ones too) and every executable in the PATH directories. It is built
+ * on first use and rebuilt only when the directory list changes
+ * (path_generation), a builtin is loaded or removed (plugin_generation)
+ * or a directory's mtime moves, so a completion costs one stat() per PATH
+ * directory plus a walk down the trie. File names come from a cached,
+ * sorted listing of one directory (usually the current one), re-read
+ * only when that directory's mtime changes.
+ */
+
+#include "../include/shell.h"
+#include <dirent.h>
+
+/* Candidates listed at most */
+#define COMPLETE_MAX_LIST 512
+
+/* Trie node; children are a sibling list sorted by character */
+typedef struct trie_node_s {
+    int child;
+    int sibling;
+    int below;                  /* Names ending at or under this node */
+    char c;
+    char terminal;
+} trie_node_t;
+
+/* Sorted listing of one directory */
+typedef struct dir_listing_s {
+    char *path;
+    struct timespec mtime;
+    char **names;
+    unsigned char *is_dir;
+    int count;
+} dir_listing_t;
+
+struct completer_s {
+    trie_node_t *nodes;         /* nodes[0] is the root */
+    int node_count;
+    int node_capacity;
+    long path_generation;       /* Directory list the trie was built from */
+    long plugin_generation;     /* ...and loaded builtins */
+    struct timespec *mtimes;    /* ...and each directory's mtime then */
+    int dir_count;
+    dir_listing_t listing;
+};
+
+static int new_node(struct completer_s *comp, char c)
+{
+    if (comp->node_count >= comp->node_capacity) {
+        int capacity = comp->node_capacity ? comp->node_capacity * 2 : 4096;
+        trie_node_t *grown = realloc(comp->nodes, capacity * sizeof(trie_node_t));
+        if (grown == NULL) return -1;
+        comp->nodes = grown;
+        comp->node_capacity = capacity;
+    }
+
+    trie_node_t *node = &comp->nodes[comp->node_count];
+    memset(node, 0, sizeof(*node));
+    node->child = node->sibling = -1;
+    node->c = c;
+    return comp->node_count++;
+}
+
+/* Child of node for c, created in order if missing and create is set */
+static int trie_child(struct completer_s *comp, int node, char c, int create)
+{
+    int prev = -1;
+    int cur = comp->nodes[node].child;
+
+    while (cur >= 0 && comp->nodes[cur].c < c) {
+        prev = cur;
+        cur = comp->nodes[cur].sibling;
+    }
+    if (cur >= 0 && comp->nodes[cur].c == c) return cur;
+    if (!create) return -1;
+
+    int added = new_node(comp, c);
+    if (added < 0) return -1;
+    comp->nodes[added].sibling = cur;
+    if (prev < 0) {
+        comp->nodes[node].child = added;
+    } else {
+        comp->nodes[prev].sibling = added;
+    }
+    return added;
+}
+
+static void trie_insert(struct completer_s *comp, const char *name)
+{
+    int path[MAX_INPUT];
+    int depth = 0;
+    int node = 0;
+
+    for (const char *p = name; *p != '\0'; p++) {
+        if (depth >= MAX_INPUT - 1) return;
+        path[depth++] = node;
+        node = trie_child(comp, node, *p, 1);
+        if (node < 0) return;
+    }
+    if (comp->nodes[node].terminal) return;
+
+    comp->nodes[node].terminal = 1;
+    comp->nodes[node].below++;
+    while (depth > 0) {
+        comp->nodes[path[--depth]].below++;
+    }
+}
+
+/* Node reached by prefix, or -1 */
+static int trie_find(struct completer_s *comp, const char *prefix)
+{
+    int node = 0;
+
+    for (const char *p = prefix; *p != '\0' && node >= 0; p++) {
+        node = trie_child(comp, node, *p, 0);
+    }
+    return node;
+}
+
+/* Append to out the names under node, in order, up to the limit */
+static void trie_collect(struct completer_s *comp, int node, buffer_t *name,
+    char **out, int *count)
+{
+    if (*count >= COMPLETE_MAX_LIST) return;
+    if (comp->nodes[node].terminal) {
+        out[(*count)++] = my_strdup(name->data ? name->data : "");
+    }
+
+    for (int child = comp->nodes[node].child; child >= 0;
+        child = comp->nodes[child].sibling) {
+        size_t len = name->len;
+        buf_append(name, &comp->nodes[child].c, 1);
+        trie_collect(comp, child, name, out, count);
+        name->len = len;
+        name->data[len] = '\0';
+    }
+}
+
+/* Has the PATH (or the set of builtins) changed since the trie was built? */
+static int trie_stale(shell_state_t *state, struct completer_s *comp)
+{
+    if (comp->node_count == 0 || comp->path_generation != state->path_generation ||
+        comp->plugin_generation != plugin_generation() ||
+        comp->dir_count != state->path_count) {
+        return 1;
+    }
+
+    for (int i = 0; i < state->path_count; i++) {
+        struct stat st;
+        if (stat(state->path_dirs[i], &st) != 0) {
+            st.st_mtim.tv_sec = st.st_mtim.tv_nsec = 0;
+        }
+        if (st.st_mtim.tv_sec != comp->mtimes[i].tv_sec ||
+            st.st_mtim.tv_nsec != comp->mtimes[i].tv_nsec) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* (Re)build the trie from the builtins and the PATH directories */
+static void trie_build(shell_state_t *state, struct completer_s *comp)
+{
+    comp->node_count = 0;
+    new_node(comp, '\0');
+
+    for (int i = 0; builtin_table[i].name != NULL; i++) {
+        trie_insert(comp, builtin_table[i].name);
+    }
+    for (int i = 0; plugin_name(i) != NULL; i++) {
+        trie_insert(comp, plugin_name(i));
+    }
+    comp->plugin_generation = plugin_generation();
+
+    free(comp->mtimes);
+    comp->mtimes = calloc(state->path_count ? state->path_count : 1,
+        sizeof(struct timespec));
+    comp->dir_count = comp->mtimes ? state->path_count : 0;
+    comp->path_generation = state->path_generation;
+
+    for (int i = 0; i < comp->dir_count; i++) {
+        DIR *dir = opendir(state->path_dirs[i]);
+        struct stat st;
+        if (dir == NULL) continue;
+
+        if (fstat(dirfd(dir), &st) == 0) {
+            comp->mtimes[i] = st.st_mtim;
+        }
+
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.') continue;
+            if (entry->d_type != DT_REG && entry->d_type != DT_LNK &&
+                entry->d_type != DT_UNKNOWN) {
+                continue;
+            }
+            if (faccessat(dirfd(dir), entry->d_name, X_OK, 0) == 0) {
+                trie_insert(comp, entry->d_name);
+            }
+        }
+        closedir(dir);
+    }
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void free_listing(dir_listing_t *listing)
+{
+    for (int i = 0; i < listing->count; i++) {
+        free(listing->names[i]);
+    }
+    free(listing->names);
+    free(listing->is_dir);
+    free(listing->path);
+    memset(listing, 0, sizeof(*listing));
+}
+
+/* Sorted names in dir (as an absolute path), from the cache if its
+ * mtime has not moved */
+static dir_listing_t *list_dir(struct completer_s *comp, const char *path)
+{
+    dir_listing_t *listing = &comp->listing;
+    struct stat st;
+
+    if (stat(path, &st) != 0) return NULL;
+    if (listing->path != NULL && strcmp(listing->path, path) == 0 &&
+        listing->mtime.tv_sec == st.st_mtim.tv_sec &&
+        listing->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+        return listing;
+    }
+
+    free_listing(listing);
+    DIR *dir = opendir(path);
+    if (dir == NULL) return NULL;
+
+    int capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (listing->count >= capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            char **names = realloc(listing->names, capacity * sizeof(char *));
+            if (names == NULL) break;
+            listing->names = names;
+        }
+        listing->names[listing->count++] = my_strdup(entry->d_name);
+    }
+    closedir(dir);
+
+    qsort(listing->names, listing->count, sizeof(char *), compare_names);
+
+    /* Directories get a trailing slash when completed */
+    listing->is_dir = calloc(listing->count ? listing->count : 1, 1);
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    for (int i = 0; i < listing->count && listing->is_dir && fd >= 0; i++) {
+        struct stat entry_st;
+        listing->is_dir[i] = fstatat(fd, listing->names[i], &entry_st, 0) == 0 &&
+            S_ISDIR(entry_st.st_mode);
+    }
+    if (fd >= 0) close(fd);
+
+    listing->path = my_strdup(path);
+    listing->mtime = st.st_mtim;
+    return listing;
+}
+
+static struct completer_s *get_completer(shell_state_t *state)
+{
+    if (state->completer == NULL) {
+        state->completer = calloc(1, sizeof(struct completer_s));
+    }
+    return state->completer;
+}
+
+/* Command names starting with prefix, sorted; returns how many there
+ * are in all (at most COMPLETE_MAX_LIST are stored in *matches) */
+static int complete_command(shell_state_t *state, const char *prefix, char ***matches)
+{
+    struct completer_s *comp = get_completer(state);
+    if (comp == NULL) return 0;
+
+    if (trie_stale(state, comp)) {
+        trie_build(state, comp);
+    }
+
+    int node = trie_find(comp, prefix);
+    if (node < 0) return 0;
+
+    int total = comp->nodes[node].below;
+    int count = 0;
+    char **out = calloc(COMPLETE_MAX_LIST + 1, sizeof(char *));
+    if (out == NULL) return 0;
+
+    buffer_t name;
+    buf_init(&name);
+    buf_append(&name, prefix, strlen(prefix));
+    trie_collect(comp, node, &name, out, &count);
+    buf_free(&name);
+
+    *matches = out;
+    return total;
+}
+
+/* File names completing word (which may include a directory part) */
+static int complete_file(shell_state_t *state, const char *word, char ***matches)
+{
+    struct completer_s *comp = get_completer(state);
+    if (comp == NULL) return 0;
+
+    const char *slash = strrchr(word, '/');
+    size_t dir_len = slash ? (size_t)(slash - word) + 1 : 0;
+    const char *base = word + dir_len;
+    size_t base_len = strlen(base);
+
+    /* The directory to list, as an absolute path */
+    buffer_t dir;
+    buf_init(&dir);
+    if (dir_len == 0 || word[0] != '/') {
+        buf_append(&dir, state->cwd, strlen(state->cwd));
+        buf_append(&dir, "/", 1);
+    }
+    buf_append(&dir, word, dir_len);
+    dir_listing_t *listing = list_dir(comp, dir.data);
+    buf_free(&dir);
+    if (listing == NULL) return 0;
+
+    /* Binary search for the first name >= base */
+    int lo = 0;
+    int hi = listing->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strcmp(listing->names[mid], base) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    char **out = calloc(COMPLETE_MAX_LIST + 1, sizeof(char *));
+    if (out == NULL) return 0;
+
+    int total = 0;
+    for (int i = lo; i < listing->count; i++) {
+        const char *name = listing->names[i];
+        if (strncmp(name, base, base_len) != 0) break;
+        if (name[0] == '.' && base[0] != '.') continue;
+
+        if (total < COMPLETE_MAX_LIST) {
+            size_t len = strlen(name);
+            char *match = malloc(dir_len + len + 2);
+            if (match != NULL) {
+                memcpy(match, word, dir_len);
+                memcpy(match + dir_len, name, len);
+                if (listing->is_dir[i]) match[dir_len + len++] = '/';
+                match[dir_len + len] = '\0';
+                out[total] = match;
+            }
+        }
+        total++;
+    }
+
+    *matches = out;
+    return total;
+}
+
+/* Is the word at start in command position (first word of a command)? */
+static int at_command_word(const char *line, size_t start)
+{
+    while (start > 0 && (line[start - 1] == ' ' || line[start - 1] == '\t')) {
+        start--;
+    }
+    if (start == 0) return 1;
+
+    char prev = line[start - 1];
+    return prev == ';' || prev == '&' || prev == '|' || prev == '(' || prev == '`';
+}
+
+/* Completions for the word ending at cursor: sets *word_start and
+ * *matches (NULL-terminated, sorted, at most COMPLETE_MAX_LIST) and
+ * returns the total number of candidates */
+int complete_line(shell_state_t *state, const char *line, size_t cursor,
+    size_t *word_start, char ***matches)
+{
+    size_t start = cursor;
+    while (start > 0 && strchr(" \t;&|<>()`", line[start - 1]) == NULL) {
+        start--;
+    }
+    *word_start = start;
+    *matches = NULL;
+
+    char *word = malloc(cursor - start + 1);
+    if (word == NULL) return 0;
+    memcpy(word, line + start, cursor - start);
+    word[cursor - start] = '\0';
+
+    int total;
+    if (at_command_word(line, start) && strchr(word, '/') == NULL) {
+        total = complete_command(state, word, matches);
+    } else {
+        total = complete_file(state, word, matches);
+    }
+    free(word);
+    return total;
+}
+
+/* Built-in: complete [-c|-f] WORD - list what WORD would complete to,
+ * as a command (-c) or a file name (-f) */
+int builtin_complete(command_t *cmd, shell_state_t *state)
+{
+    int command = 1;
+    int i = 1;
+
+    if (cmd->args[i] != NULL && strcmp(cmd->args[i], "-f") == 0) {
+        command = 0;
+        i++;
+    } else if (cmd->args[i] != NULL && strcmp(cmd->args[i], "-c") == 0) {
+        i++;
+    }
+    const char *word = cmd->args[i] ? cmd->args[i] : "";
+
+    char **matches = NULL;
+    int total = command && strchr(word, '/') == NULL ?
+        complete_command(state, word, &matches) : complete_file(state, word, &matches);
+
+    for (int j = 0; matches != NULL && matches[j] != NULL; j++) {
+        fprintf(state->out, "%s\n", matches[j]);
+    }
+    free_string_array(matches);
+    return total > 0 ? 0 : 1;
+}
+
+/* Free the trie and the cached listing */
+void complete_free(shell_state_t *state)
+{
+    struct completer_s *comp = state->completer;
+    if (comp == NULL) return;
+
+    free(comp->nodes);
+    free(comp->mtimes);
+    free_listing(&comp->listing);
+    free(comp);
+    state->completer = NULL;
+}
\ No newline at end of file
@@ -0,0 +1,195 @@
+/* src/coproc.c - coproc builtin: a long-lived worker on two pipes
+ *
+ *     coproc NAME command [args...]
+ *     echo request >&$NAME_WFD
+ *     read -u $NAME_RFD reply
+ *
+ * The command (always a program from the search path, even where a
+ * builtin shares its name) is started like a background job, shown in
+ * `jobs`, with its stdin and stdout on pipes. The shell keeps the other
+ * ends, above fd 10 and close-on-exec so later commands do not hold
+ * them, and publishes them as $NAME_WFD (write requests) and $NAME_RFD
+ * (read replies), with $NAME_PID. A script can then stream many requests to
+ * one warm interpreter instead of starting it once per line.
+ *
+ * On exit the shell closes its ends, so a worker reading to EOF ends
+ * by itself; one still running after a grace period gets SIGTERM.
+ */
+
+#include "../include/shell.h"
+#include <poll.h>
+#include <sys/pidfd.h>
+
+#define COPROC_GRACE_MS 1000
+
+struct coproc_s {
+    char *name;
+    pid_t pid;
+    int rfd;                    /* Shell's end of the worker's stdout */
+    int wfd;                    /* Shell's end of the worker's stdin */
+    struct coproc_s *next;
+};
+
+/* Is the coprocess still in the job table (not yet reaped)? */
+static int coproc_running(shell_state_t *state, struct coproc_s *co)
+{
+    jobs_reap(state);
+    for (job_t *job = state->jobs; job != NULL; job = job->next) {
+        if (job->pid == co->pid) return 1;
+    }
+    return 0;
+}
+
+/* Unlink and close a coprocess whose worker has gone */
+static void coproc_forget(shell_state_t *state, struct coproc_s *co)
+{
+    for (struct coproc_s **link = &state->coprocs; *link != NULL; link = &(*link)->next) {
+        if (*link == co) {
+            *link = co->next;
+            break;
+        }
+    }
+    close(co->rfd);
+    close(co->wfd);
+    free(co->name);
+    free(co);
+}
+
+/* Publish NAME_SUFFIX=value */
+static void set_coproc_var(shell_state_t *state, const char *name, const char *suffix,
+    long value)
+{
+    char var[256];
+    char num[32];
+
+    snprintf(var, sizeof(var), "%s_%s", name, suffix);
+    snprintf(num, sizeof(num), "%ld", value);
+    set_shell_var(state, var, num);
+}
+
+/* Move a pipe end out of the way of fds 0-9 (close-on-exec) */
+static int move_high(int fd)
+{
+    int moved = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+    close(fd);
+    return moved;
+}
+
+/* Built-in: coproc NAME command [args...] */
+int builtin_coproc(command_t *cmd, shell_state_t *state)
+{
+    const char *name = cmd->args[1];
+
+    if (name == NULL || cmd->args[2] == NULL) {
+        fprintf(stderr, "coproc: usage: coproc NAME command [args...]\n");
+        return 1;
+    }
+    for (const char *p = name; *p != '\0'; p++) {
+        if (!isalnum((unsigned char)*p) && *p != '_') {
+            fprintf(stderr, "coproc: %s: not a valid name\n", name);
+            return 1;
+        }
+    }
+
+    for (struct coproc_s *co = state->coprocs; co != NULL; co = co->next) {
+        if (strcmp(co->name, name) != 0) continue;
+        if (coproc_running(state, co)) {
+            fprintf(stderr, "coproc: %s: already running (pid %d)\n", name, (int)co->pid);
+            return 1;
+        }
+        coproc_forget(state, co);
+        break;
+    }
+
+    /* to_worker[0] and from_worker[1] become the worker's stdin/stdout */
+    int to_worker[2];
+    int from_worker[2];
+    if (pipe2(to_worker, O_CLOEXEC) != 0) {
+        print_error();
+        return 1;
+    }
+    if (pipe2(from_worker, O_CLOEXEC) != 0) {
+        print_error();
+        close(to_worker[0]);
+        close(to_worker[1]);
+        return 1;
+    }
+    int wfd = move_high(to_worker[1]);
+    int rfd = move_high(from_worker[0]);
+
+    /* The worker inherits the shell's fds 0 and 1: swap them for the spawn */
+    fflush(stdout);
+    int saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+    int saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    pid_t pid = -1;
+    if (wfd >= 0 && rfd >= 0 && saved_in >= 0 && saved_out >= 0 &&
+        dup2(to_worker[0], STDIN_FILENO) >= 0 &&
+        dup2(from_worker[1], STDOUT_FILENO) >= 0) {
+        command_t sub;
+        memset(&sub, 0, sizeof(sub));
+        sub.args = cmd->args + 2;
+        sub.next_op = OP_NONE;
+        pid = spawn_external(&sub, state);
+    }
+    if (saved_in >= 0) {
+        dup2(saved_in, STDIN_FILENO);
+        close(saved_in);
+    }
+    if (saved_out >= 0) {
+        dup2(saved_out, STDOUT_FILENO);
+        close(saved_out);
+    }
+    close(to_worker[0]);
+    close(from_worker[1]);
+
+    struct coproc_s *co = pid > 0 ? calloc(1, sizeof(struct coproc_s)) : NULL;
+    if (co == NULL) {
+        if (pid > 0) {
+            kill(pid, SIGTERM);
+            job_wait(state, pid);
+        }
+        if (wfd >= 0) close(wfd);
+        if (rfd >= 0) close(rfd);
+        return pid > 0 ? 1 : state->last_exit_status;
+    }
+
+    char label[300];
+    snprintf(label, sizeof(label), "coproc %s", name);
+    job_add(state, pid, label);
+
+    co->name = my_strdup(name);
+    co->pid = pid;
+    co->rfd = rfd;
+    co->wfd = wfd;
+    co->next = state->coprocs;
+    state->coprocs = co;
+
+    set_coproc_var(state, name, "RFD", rfd);
+    set_coproc_var(state, name, "WFD", wfd);
+    set_coproc_var(state, name, "PID", pid);
+    return 0;
+}
+
+/* Close every coprocess's pipes and reap the workers */
+void coproc_stop(shell_state_t *state)
+{
+    while (state->coprocs != NULL) {
+        struct coproc_s *co = state->coprocs;
+        int running = coproc_running(state, co);
+        pid_t pid = co->pid;
+
+        /* EOF on its stdin is the worker's cue to finish */
+        coproc_forget(state, co);
+        if (!running) continue;
+
+        int pidfd = (int)pidfd_open(pid, 0);
+        if (pidfd >= 0) {
+            struct pollfd pfd = { pidfd, POLLIN, 0 };
+            if (poll(&pfd, 1, COPROC_GRACE_MS) <= 0) kill(pid, SIGTERM);
+            close(pidfd);
+        } else {
+            kill(pid, SIGTERM);
+        }
+        job_wait(state, pid);
+    }
+}
\ No newline at end of file
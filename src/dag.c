@@ -0,0 +1,498 @@
+/* src/dag.c - Run a batch script as a dependency graph (-j N)
+ *
+ * A command line may be preceded by an annotation comment
+ *
+ *     #@ in=a.c,a.h out=a.o label=compile after=gen
+ *
+ * naming the files it reads and writes and labels it must wait for.
+ * A line depends on the nearest earlier line that writes one of its
+ * inputs and on every line carrying a label it names. Annotated lines
+ * run in forked workers, at most N at once, and are skipped when all
+ * their outputs exist and are no older than their inputs, or when a
+ * line they depend on failed. Lines without an annotation are barriers:
+ * they run in the shell itself, once every earlier line has finished,
+ * and every later line waits for them, so cd and setenv between steps
+ * keep their sequential meaning. A barrier only orders: it runs even
+ * if an earlier line failed, and its own failure skips nothing. The
+ * shell sleeps in poll() on the workers' pidfds, so background jobs a
+ * barrier started are left for wait and jobs.
+ */
+
+#include "../include/shell.h"
+#include <poll.h>
+#include <sys/pidfd.h>
+
+/* Node progress */
+typedef enum {
+    NODE_WAITING,
+    NODE_RUNNING,
+    NODE_DONE,
+    NODE_FAILED                 /* Failed itself, or a dependency did */
+} node_state_t;
+
+typedef struct dag_node_s {
+    input_line_t line;          /* Text, line number, here-doc bodies */
+    char **in;                  /* Files read (NULL-terminated) */
+    char **out;                 /* Files written */
+    char **after;               /* Labels waited for */
+    char *label;
+    int barrier;                /* Unannotated: runs in the shell */
+    int *deps;                  /* Indices of nodes it waits for */
+    int dep_count;
+    node_state_t state;
+    int status;
+    pid_t pid;
+    int pidfd;                  /* While running, or -1 */
+} dag_node_t;
+
+typedef struct dag_s {
+    dag_node_t *nodes;
+    int count;
+    int capacity;
+} dag_t;
+
+/* Read one line of the script, counting it */
+static char *dag_read_line(shell_state_t *state)
+{
+    char *text = read_script_line(state->batch_fp);
+    if (text != NULL) state->lineno++;
+    return text;
+}
+
+/* dag_read_line() for join_loop_lines() and read_heredoc_lines() */
+static char *dag_read_loop_line(void *state)
+{
+    return dag_read_line(state);
+}
+
+/* Fill in a node from an "#@ key=value ..." annotation */
+static void parse_annotation(dag_node_t *node, const char *text, int lineno)
+{
+    int count;
+    char **words = split_string((char *)text + 2, " \t", &count);
+    if (words == NULL) return;
+
+    for (int i = 0; i < count; i++) {
+        char *value = strchr(words[i], '=');
+        if (value == NULL) {
+            fprintf(stderr, "line %d: bad annotation '%s'\n", lineno, words[i]);
+            continue;
+        }
+        *value++ = '\0';
+
+        char ***list = NULL;
+        if (strcmp(words[i], "in") == 0) {
+            list = &node->in;
+        } else if (strcmp(words[i], "out") == 0) {
+            list = &node->out;
+        } else if (strcmp(words[i], "after") == 0) {
+            list = &node->after;
+        } else if (strcmp(words[i], "label") == 0) {
+            free(node->label);
+            node->label = my_strdup(value);
+            continue;
+        } else {
+            fprintf(stderr, "line %d: unknown annotation '%s'\n", lineno, words[i]);
+            continue;
+        }
+        free_string_array(*list);
+        *list = split_string(value, ",", NULL);
+    }
+    free_string_array(words);
+}
+
+/* Read the whole script into nodes */
+static int dag_load(dag_t *dag, shell_state_t *state)
+{
+    dag_node_t pending;
+    int annotated = 0;
+    char *text;
+
+    memset(&pending, 0, sizeof(pending));
+
+    while ((text = dag_read_line(state)) != NULL) {
+        if (strncmp(text, "#@", 2) == 0) {
+            parse_annotation(&pending, text, state->lineno);
+            annotated = 1;
+            free(text);
+            continue;
+        }
+        if (text[0] == '\0' || text[0] == '#') {
+            free(text);
+            continue;
+        }
+        int lineno = state->lineno;
+        if (loop_depth(text) > 0) {
+            text = join_loop_lines(text, dag_read_loop_line, state);
+        }
+
+        if (dag->count >= dag->capacity) {
+            int capacity = dag->capacity ? dag->capacity * 2 : 64;
+            dag_node_t *grown = realloc(dag->nodes, capacity * sizeof(dag_node_t));
+            if (grown == NULL) {
+                free(text);
+                return -1;
+            }
+            dag->nodes = grown;
+            dag->capacity = capacity;
+        }
+
+        dag_node_t *node = &dag->nodes[dag->count++];
+        *node = pending;
+        node->barrier = !annotated;
+        node->line.text = text;
+        node->line.lineno = lineno;
+        memset(&pending, 0, sizeof(pending));
+        annotated = 0;
+
+        /* Here-document bodies belong to the line */
+        if (!starts_loop(text)) {
+            read_heredoc_lines(&node->line, dag_read_loop_line, state);
+        }
+    }
+
+    /* A trailing annotation has no line to apply to */
+    free_string_array(pending.in);
+    free_string_array(pending.out);
+    free_string_array(pending.after);
+    free(pending.label);
+    return 0;
+}
+
+/* Is name in the NULL-terminated list? */
+static int list_has(char **list, const char *name)
+{
+    for (int i = 0; list != NULL && list[i] != NULL; i++) {
+        if (strcmp(list[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+/* Record that node waits for node dep */
+static void add_dep(dag_node_t *node, int dep)
+{
+    for (int i = 0; i < node->dep_count; i++) {
+        if (node->deps[i] == dep) return;
+    }
+    int *grown = realloc(node->deps, (node->dep_count + 1) * sizeof(int));
+    if (grown == NULL) return;
+    node->deps = grown;
+    node->deps[node->dep_count++] = dep;
+}
+
+/* Derive the edges from files, labels and barriers */
+static void dag_link(dag_t *dag)
+{
+    int barrier = -1;
+
+    for (int n = 0; n < dag->count; n++) {
+        dag_node_t *node = &dag->nodes[n];
+
+        if (node->barrier) {
+            /* Lines before the previous barrier already precede it */
+            for (int prev = barrier < 0 ? 0 : barrier; prev < n; prev++) {
+                add_dep(node, prev);
+            }
+            barrier = n;
+            continue;
+        }
+        if (barrier >= 0) {
+            add_dep(node, barrier);
+        }
+
+        /* Nearest earlier writer of each input, even across a barrier:
+         * that only orders, so it would not pass a failure on */
+        for (int i = 0; node->in != NULL && node->in[i] != NULL; i++) {
+            for (int prev = n - 1; prev >= 0; prev--) {
+                if (list_has(dag->nodes[prev].out, node->in[i])) {
+                    add_dep(node, prev);
+                    break;
+                }
+            }
+        }
+
+        /* Every line carrying a named label */
+        for (int i = 0; node->after != NULL && node->after[i] != NULL; i++) {
+            for (int other = 0; other < dag->count; other++) {
+                if (other != n && dag->nodes[other].label != NULL &&
+                    strcmp(dag->nodes[other].label, node->after[i]) == 0) {
+                    add_dep(node, other);
+                }
+            }
+        }
+    }
+}
+
+/* Are all of the node's outputs present and no older than its inputs? */
+static int up_to_date(dag_node_t *node)
+{
+    struct stat st;
+    struct timespec oldest_out = { 0, 0 };
+    int first = 1;
+
+    if (node->out == NULL || node->out[0] == NULL) return 0;
+
+    for (int i = 0; node->out[i] != NULL; i++) {
+        if (stat(node->out[i], &st) != 0) return 0;
+        if (first || st.st_mtim.tv_sec < oldest_out.tv_sec ||
+            (st.st_mtim.tv_sec == oldest_out.tv_sec &&
+             st.st_mtim.tv_nsec < oldest_out.tv_nsec)) {
+            oldest_out = st.st_mtim;
+            first = 0;
+        }
+    }
+
+    for (int i = 0; node->in != NULL && node->in[i] != NULL; i++) {
+        if (stat(node->in[i], &st) != 0) return 0;
+        if (st.st_mtim.tv_sec > oldest_out.tv_sec ||
+            (st.st_mtim.tv_sec == oldest_out.tv_sec &&
+             st.st_mtim.tv_nsec > oldest_out.tv_nsec)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Parse and run a node's line in the current process */
+static int run_line(dag_node_t *node, shell_state_t *state)
+{
+    if (starts_loop(node->line.text)) {
+        run_loop(node->line.text, state);
+        return state->exit_requested ? state->exit_status : state->last_exit_status;
+    }
+
+    state->pending_lines = node->line.heredoc_lines;
+    state->pending_count = node->line.heredoc_count;
+    state->pending_next = 0;
+
+    command_t *cmd = parse_command(node->line.text, state);
+    if (cmd == NULL) {
+        state->pending_lines = NULL;
+        return 1;
+    }
+    collect_heredocs(cmd, state);
+    if (cmd->args[0] != NULL) {
+        execute_chain(cmd, state);
+    }
+    free_command(cmd);
+
+    state->pending_lines = NULL;
+    state->pending_count = 0;
+    return state->exit_requested ? state->exit_status : state->last_exit_status;
+}
+
+/* Fork a worker for a node */
+static int start_worker(dag_node_t *node, shell_state_t *state)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        print_error();
+        return -1;
+    }
+    state->metrics.forks++;
+
+    if (pid == 0) {
+        /* The zygote and journal belong to the shell, not to workers */
+        state->zygote = NULL;
+        state->journal = NULL;
+        state->exec_tail = 1;
+        int status = run_line(node, state);
+        fflush(stdout);
+        _exit(status);
+    }
+
+    node->pid = pid;
+    node->pidfd = (int)pidfd_open(pid, 0);
+    node->state = NODE_RUNNING;
+    return 0;
+}
+
+/* Mark a node finished and journal it */
+static void finish_node(dag_node_t *node, shell_state_t *state, int status)
+{
+    node->status = status;
+    node->state = status == 0 ? NODE_DONE : NODE_FAILED;
+    journal_record(state, node->line.lineno, node->line.text, status);
+}
+
+/* Reap a worker that has exited (or block until it does) */
+static void reap_worker(dag_node_t *node, shell_state_t *state)
+{
+    int status;
+
+    while (wait_child(state, node->pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            status = 1 << 8;
+            break;
+        }
+    }
+    if (node->pidfd >= 0) {
+        close(node->pidfd);
+        node->pidfd = -1;
+    }
+    finish_node(node, state, exit_code(status));
+}
+
+/* Wait for one worker to exit; returns its node, or NULL if none is
+ * running. Only workers are reaped, never other children */
+static dag_node_t *wait_worker(dag_t *dag, shell_state_t *state)
+{
+    struct pollfd fds[dag->count];
+    int index[dag->count];
+    int n = 0;
+
+    for (int i = 0; i < dag->count; i++) {
+        dag_node_t *node = &dag->nodes[i];
+        if (node->state != NODE_RUNNING) continue;
+        if (node->pidfd < 0) {
+            /* No pidfd: just wait for this one */
+            reap_worker(node, state);
+            return node;
+        }
+        fds[n].fd = node->pidfd;
+        fds[n].events = POLLIN;
+        index[n++] = i;
+    }
+    if (n == 0) return NULL;
+
+    while (poll(fds, n, -1) < 0) {
+        if (errno != EINTR) return NULL;
+    }
+    for (int k = 0; k < n; k++) {
+        if (fds[k].revents != 0) {
+            dag_node_t *node = &dag->nodes[index[k]];
+            reap_worker(node, state);
+            return node;
+        }
+    }
+    return NULL;
+}
+
+/* Release the graph */
+static void dag_free(dag_t *dag)
+{
+    for (int n = 0; n < dag->count; n++) {
+        dag_node_t *node = &dag->nodes[n];
+        free(node->line.text);
+        for (int i = 0; i < node->line.heredoc_count; i++) {
+            free(node->line.heredoc_lines[i]);
+        }
+        free(node->line.heredoc_lines);
+        free_string_array(node->in);
+        free_string_array(node->out);
+        free_string_array(node->after);
+        free(node->label);
+        free(node->deps);
+    }
+    free(dag->nodes);
+}
+
+/* Execute the batch script as a graph with up to state->dag_jobs
+ * workers; the exit status is that of the last failure, if any */
+void run_dag(shell_state_t *state)
+{
+    dag_t dag;
+    int running = 0;
+    int remaining;
+    int failure = 0;
+
+    memset(&dag, 0, sizeof(dag));
+    if (dag_load(&dag, state) != 0) {
+        print_error();
+        dag_free(&dag);
+        state->exit_status = 1;
+        return;
+    }
+    dag_link(&dag);
+    remaining = dag.count;
+
+    while (remaining > 0 && !state->exit_requested) {
+        int progressed = 0;
+
+        for (int n = 0; n < dag.count; n++) {
+            dag_node_t *node = &dag.nodes[n];
+            if (node->state != NODE_WAITING) continue;
+
+            /* An edge to or from a barrier only orders the two lines */
+            int ready = 1;
+            int broken = 0;
+            for (int d = 0; d < node->dep_count; d++) {
+                dag_node_t *dep = &dag.nodes[node->deps[d]];
+                if (dep->state == NODE_FAILED && !dep->barrier && !node->barrier) {
+                    broken = 1;
+                } else if (dep->state != NODE_DONE && dep->state != NODE_FAILED) {
+                    ready = 0;
+                }
+            }
+
+            if (broken) {
+                fprintf(stderr, "line %d: skipped, a dependency failed\n", node->line.lineno);
+                node->state = NODE_FAILED;
+                node->status = 1;
+                failure = 1;
+                remaining--;
+                progressed = 1;
+                continue;
+            }
+            if (!ready) continue;
+
+            if (journal_skip(state, node->line.lineno, node->line.text) ||
+                (!node->barrier && up_to_date(node))) {
+                node->state = NODE_DONE;
+                remaining--;
+                progressed = 1;
+                continue;
+            }
+
+            if (node->barrier) {
+                /* Every earlier node is done, so nothing is running */
+                state->exec_tail = 0;
+                finish_node(node, state, run_line(node, state));
+                if (node->status != 0) failure = node->status;
+                remaining--;
+                progressed = 1;
+                if (state->exit_requested) break;
+                continue;
+            }
+
+            if (running >= state->dag_jobs) continue;
+            if (start_worker(node, state) != 0) {
+                finish_node(node, state, 1);
+                failure = 1;
+                remaining--;
+                progressed = 1;
+                continue;
+            }
+            running++;
+            progressed = 1;
+        }
+
+        if (running > 0) {
+            dag_node_t *done = wait_worker(&dag, state);
+            if (done == NULL) {
+                print_error();
+                failure = 1;
+                break;
+            }
+            running--;
+            remaining--;
+            if (done->status != 0) failure = done->status;
+        } else if (!progressed) {
+            /* Nothing running and nothing ready: the labels form a cycle */
+            fprintf(stderr, "dependency cycle among remaining lines\n");
+            failure = 1;
+            break;
+        }
+    }
+
+    /* Let workers still running after exit finish */
+    while (running > 0 && wait_worker(&dag, state) != NULL) {
+        running--;
+    }
+
+    if (!state->exit_requested) {
+        state->exit_status = failure;
+    }
+    dag_free(&dag);
+}
\ No newline at end of file
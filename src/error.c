@@ -1,6 +1,15 @@
 #include "../include/shell.h"
 
+/* Threads that parse speculatively report errors later, on re-parse */
+static __thread int errors_quiet;
+
+void set_errors_quiet(int quiet)
+{
+    errors_quiet = quiet;
+}
+
 void print_error(void)
 {
+    if (errors_quiet) return;
     fprintf(stderr, ERROR_MSG);
 }
\ No newline at end of file
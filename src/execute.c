@@ -1,65 +1,110 @@
 #include "../include/shell.h"
 
+/* Built-in commands, with what the rest of the shell needs to know
+ * about each */
+const builtin_t builtin_table[] = {
+    { "exit", BUILTIN_STATEFUL },
+    { "cd", BUILTIN_STATEFUL },
+    { "env", 0 },
+    { "setenv", BUILTIN_STATEFUL },
+    { "unsetenv", BUILTIN_STATEFUL },
+    { "alias", BUILTIN_STATEFUL },
+    { "path", BUILTIN_STATEFUL },
+    { "echo", 0 },
+    { "pwd", 0 },
+    { "jobs", 0 },
+    { "stats", 0 },
+    { "timeout", 0 },
+    { "retry", 0 },
+    { "cache", 0 },
+    { "read", BUILTIN_STATEFUL },
+    { "times", 0 },
+    { "complete", 0 },
+    { "history", 0 },
+    { "enable", BUILTIN_STATEFUL },
+    { "forall", BUILTIN_STATEFUL | BUILTIN_DEFER_ARGS },
+    { "coproc", BUILTIN_STATEFUL },
+    { "cat", 0 },
+    { "tee", 0 },
+    { "source", BUILTIN_STATEFUL },
+    { ".", BUILTIN_STATEFUL },
+    { "exec", BUILTIN_STATEFUL },
+    { NULL, 0 }
+};
+
+/* BUILTIN_* flags of a command, or -1 if it is not a builtin. Loaded
+ * builtins may set variables, so they count as stateful */
+int builtin_flags(const char *cmd)
+{
+    if (cmd == NULL) return -1;
+    for (int i = 0; builtin_table[i].name != NULL; i++) {
+        if (strcmp(cmd, builtin_table[i].name) == 0) return builtin_table[i].flags;
+    }
+    return is_plugin(cmd) ? BUILTIN_STATEFUL : -1;
+}
+
 /* Check if command is built-in */
 int is_builtin(char *cmd)
 {
-    if (cmd == NULL) return 0;
-    return (strcmp(cmd, "exit") == 0 || strcmp(cmd, "cd") == 0 ||
-        strcmp(cmd, "env") == 0 || strcmp(cmd, "setenv") == 0 ||
-        strcmp(cmd, "unsetenv") == 0 || strcmp(cmd, "alias") == 0 ||
-        strcmp(cmd, "path") == 0);
+    return builtin_flags(cmd) >= 0;
 }
 
 /* Setup redirection */
 static int setup_redirection(command_t *cmd)
 {
-    if (cmd->output_file != NULL) {
-        int fd = open(cmd->output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd < 0) {
-            print_error();
-            return -1;
-        }
-        
-        if (dup2(fd, STDOUT_FILENO) < 0) {
-            close(fd);
-            print_error();
-            return -1;
-        }
-        
-        if (dup2(fd, STDERR_FILENO) < 0) {
-            close(fd);
-            print_error();
-            return -1;
-        }
-        
-        close(fd);
-    }
+    return apply_redirections(cmd->redirs, NULL);
+}
+
+/* Can this command be spawned through the zygote? Its fds 0-2 are
+ * passed along, but nothing else the shell holds open (such as the fds
+ * of `exec 3>log`) */
+static int can_use_zygote(command_t *cmd, shell_state_t *state)
+{
+    if (state->zygote == NULL || cmd->procsubs != NULL || state->exec_fds != 0) return 0;
     
-    return 0;
+    for (redirect_t *r = cmd->redirs; r != NULL; r = r->next) {
+        if (r->fd > STDERR_FILENO) return 0;
+        if (r->type == REDIR_DUP && r->target_fd < 0) return 0;
+    }
+    return 1;
 }
 
-/* Execute external command */
-int execute_external(command_t *cmd, shell_state_t *state)
+/* Spawn through the zygote, redirecting the shell's own fds 0-2 for
+ * the duration of the request */
+static pid_t spawn_via_zygote(command_t *cmd, shell_state_t *state, char *cmd_path)
 {
-    pid_t pid;
-    int status;
+    redir_save_t save;
     
-    /* Find command */
-    char *cmd_path = find_command_in_path(cmd->args[0], state);
-    if (cmd_path == NULL) {
-        fprintf(stderr, "%s: command not found\n", cmd->args[0]);
-        return 127;
+    if (apply_redirections(cmd->redirs, &save) != 0) {
+        restore_redirections(&save);
+        return -1;
     }
+    pid_t pid = zygote_spawn(state, cmd_path, cmd->args);
+    restore_redirections(&save);
     
-    pid = fork();
     if (pid < 0) {
-        free(cmd_path);
         print_error();
-        return 1;
+    } else if (state->spawn_cpu >= 0) {
+        pin_to_cpu(pid, state->spawn_cpu);
     }
+    return pid;
+}
+
+/* Fork the shell and exec in the child */
+static pid_t spawn_forked(command_t *cmd, shell_state_t *state, char *cmd_path)
+{
+    pid_t pid = fork();
+    if (pid < 0) {
+        print_error();
+        return -1;
+    }
+    state->metrics.forks++;
     
     if (pid == 0) {
         /* Child process */
+        if (state->spawn_cpu >= 0) {
+            pin_to_cpu(0, state->spawn_cpu);
+        }
         if (setup_redirection(cmd) != 0) {
             free(cmd_path);
             exit(1);
@@ -75,36 +120,194 @@ int execute_external(command_t *cmd, shell_state_t *state)
             free(cmd_path);
             exit(1);
         }
+    }
+    
+    return pid;
+}
+
+/* Start an external command without waiting for it. Returns the pid,
+ * or -1 with state->last_exit_status set */
+pid_t spawn_external(command_t *cmd, shell_state_t *state)
+{
+    pid_t pid;
+    
+    /* Find command */
+    char *cmd_path = find_command_in_path(cmd->args[0], state);
+    if (cmd_path == NULL) {
+        fprintf(stderr, "%s: command not found\n", cmd->args[0]);
+        state->last_exit_status = 127;
+        return -1;
+    }
+    
+    /* Start process substitutions before the command that reads them */
+    if (cmd->procsubs != NULL && start_procsubs(cmd, state) != 0) {
+        free(cmd_path);
+        wait_procsubs(cmd, state);
+        state->last_exit_status = 1;
+        return -1;
+    }
+    
+    /* Keep builtin output ahead of the child's */
+    fflush(stdout);
+    
+    if (can_use_zygote(cmd, state)) {
+        pid = spawn_via_zygote(cmd, state, cmd_path);
     } else {
-        /* Parent process */
+        pid = spawn_forked(cmd, state, cmd_path);
+    }
+    free(cmd_path);
+    
+    if (pid < 0) {
+        wait_procsubs(cmd, state);
+        state->last_exit_status = 1;
+        return -1;
+    }
+    
+    close_procsub_fds(cmd);
+    state->metrics.execs++;
+    return pid;
+}
+
+/* Tail exec: replace the shell with the final command of its input
+ * instead of forking and waiting. Returns -1 if the command should take
+ * the normal path, else the status of a failed attempt */
+int exec_in_place(command_t *cmd, shell_state_t *state)
+{
+    redir_save_t save;
+    
+    char *cmd_path = find_command_in_path(cmd->args[0], state);
+    if (cmd_path == NULL) {
+        return -1;
+    }
+    
+    fflush(stdout);
+    if (apply_redirections(cmd->redirs, &save) != 0) {
+        restore_redirections(&save);
         free(cmd_path);
-        
-        if (cmd->background) {
-            /* Background process - don't wait */
-            printf("[%d]\n", pid);
-            state->last_exit_status = 0;
-            return 0;
-        } else {
-            /* Wait for foreground process */
-            waitpid(pid, &status, 0);
-            
-            if (WIFEXITED(status)) {
-                state->last_exit_status = WEXITSTATUS(status);
-                return state->last_exit_status;
-            } else {
-                state->last_exit_status = 1;
-                return 1;
-            }
+        return 1;
+    }
+    
+    /* Saved fds are close-on-exec and vanish with the shell */
+    state->metrics.execs++;
+    metrics_write(state);
+    execv(cmd_path, cmd->args);
+    
+    int status = 1;
+    if (errno == EACCES) {
+        fprintf(stderr, "%s: permission denied\n", cmd->args[0]);
+        status = 126;
+    } else {
+        perror("execv");
+    }
+    restore_redirections(&save);
+    free(cmd_path);
+    return status;
+}
+
+/* Enter a started background job in the job table: it and its
+ * substitutions are reaped from there later */
+static void track_background(shell_state_t *state, command_t *cmd, pid_t pid, int cpu,
+    output_tap_t *tap)
+{
+    job_t *job = job_add(state, pid, cmd->args[0]);
+    if (job != NULL) {
+        job->background = 1;
+        job->cpu = cpu;
+    }
+    if (tap != NULL) {
+        outmux_attach(state, cmd, tap, job ? job->id : 0, pid);
+    }
+    state->jobs_started++;
+    printf("[%d]\n", pid);
+    state->last_bg_pid = pid;
+    state->last_exit_status = 0;
+}
+
+/* Execute external command */
+int execute_external(command_t *cmd, shell_state_t *state)
+{
+    int status;
+    struct rusage usage;
+    
+    /* Nothing runs after the last command of the input (unless the
+     * shell still has background output to forward) */
+    if (state->exec_tail && cmd->next == NULL && !cmd->background &&
+        cmd->procsubs == NULL && state->outmux == NULL) {
+        status = exec_in_place(cmd, state);
+        if (status >= 0) {
+            state->last_exit_status = status;
+            return status;
         }
     }
     
-    return 0;
+    /* Background jobs may have to wait for a slot, get a CPU and
+     * have their output tagged */
+    int cpu = -1;
+    output_tap_t tap;
+    int tapped = 0;
+    if (cmd->background) {
+        job_throttle(state);
+        cpu = job_pick_cpu(state);
+        tapped = outmux_wanted() && outmux_tap(state, cmd, &tap) == 0;
+    }
+    
+    state->spawn_cpu = cpu;
+    pid_t pid = spawn_external(cmd, state);
+    state->spawn_cpu = -1;
+    if (pid < 0) {
+        if (tapped) outmux_attach(state, cmd, &tap, 0, -1);
+        return state->last_exit_status;
+    }
+    
+    if (cmd->background) {
+        track_background(state, cmd, pid, cpu, tapped ? &tap : NULL);
+        return 0;
+    }
+    
+    /* Wait for foreground process */
+    memset(&usage, 0, sizeof(usage));
+    while (wait_child_usage(state, pid, &status, 0, &usage) < 0) {
+        if (errno != EINTR) {
+            status = 1 << 8;
+            break;
+        }
+    }
+    usage_set_last(state, &usage);
+    if (cmd->procsubs != NULL) {
+        wait_procsubs(cmd, state);
+    }
+    
+    if (WIFEXITED(status)) {
+        state->last_exit_status = WEXITSTATUS(status);
+    } else {
+        state->last_exit_status = 1;
+    }
+    return state->last_exit_status;
 }
 
 /* Execute built-in command */
 int execute_builtin(command_t *cmd, shell_state_t *state)
 {
     int result;
+    redir_save_t save;
+    
+    if (cmd->procsubs != NULL && start_procsubs(cmd, state) != 0) {
+        wait_procsubs(cmd, state);
+        state->last_exit_status = 1;
+        return 1;
+    }
+    
+    /* Builtins run in-process, so redirect the shell itself and undo it;
+     * exec's redirections are meant to stay */
+    int keep_redirs = strcmp(cmd->args[0], "exec") == 0;
+    if (cmd->redirs != NULL && !keep_redirs) {
+        fflush(state->out);
+        if (apply_redirections(cmd->redirs, &save) != 0) {
+            restore_redirections(&save);
+            state->last_exit_status = 1;
+            return 1;
+        }
+    }
     
     if (strcmp(cmd->args[0], "exit") == 0) {
         result = builtin_exit(cmd, state);
@@ -120,27 +323,117 @@ int execute_builtin(command_t *cmd, shell_state_t *state)
         result = builtin_alias(cmd, state);
     } else if (strcmp(cmd->args[0], "path") == 0) {
         result = builtin_path(cmd, state);
+    } else if (strcmp(cmd->args[0], "echo") == 0) {
+        result = builtin_echo(cmd, state);
+    } else if (strcmp(cmd->args[0], "pwd") == 0) {
+        result = builtin_pwd(cmd, state);
+    } else if (strcmp(cmd->args[0], "jobs") == 0) {
+        result = builtin_jobs(cmd, state);
+    } else if (strcmp(cmd->args[0], "stats") == 0) {
+        result = builtin_stats(cmd, state);
+    } else if (strcmp(cmd->args[0], "timeout") == 0) {
+        result = builtin_timeout(cmd, state);
+    } else if (strcmp(cmd->args[0], "retry") == 0) {
+        result = builtin_retry(cmd, state);
+    } else if (strcmp(cmd->args[0], "cache") == 0) {
+        result = builtin_cache(cmd, state);
+    } else if (strcmp(cmd->args[0], "read") == 0) {
+        result = builtin_read(cmd, state);
+    } else if (strcmp(cmd->args[0], "times") == 0) {
+        result = builtin_times(cmd, state);
+    } else if (strcmp(cmd->args[0], "complete") == 0) {
+        result = builtin_complete(cmd, state);
+    } else if (strcmp(cmd->args[0], "history") == 0) {
+        result = builtin_history(cmd, state);
+    } else if (strcmp(cmd->args[0], "enable") == 0) {
+        result = builtin_enable(cmd, state);
+    } else if (strcmp(cmd->args[0], "forall") == 0) {
+        result = builtin_forall(cmd, state);
+    } else if (strcmp(cmd->args[0], "coproc") == 0) {
+        result = builtin_coproc(cmd, state);
+    } else if (strcmp(cmd->args[0], "cat") == 0) {
+        result = builtin_cat(cmd, state);
+    } else if (strcmp(cmd->args[0], "tee") == 0) {
+        result = builtin_tee(cmd, state);
+    } else if (strcmp(cmd->args[0], "source") == 0 || strcmp(cmd->args[0], ".") == 0) {
+        result = builtin_source(cmd, state);
+    } else if (strcmp(cmd->args[0], "exec") == 0) {
+        result = builtin_exec(cmd, state);
+    } else if (is_plugin(cmd->args[0])) {
+        result = run_plugin(cmd, state);
     } else {
         result = 1;
     }
     
+    if (cmd->redirs != NULL && !keep_redirs) {
+        fflush(state->out);
+        restore_redirections(&save);
+    }
+    
+    if (cmd->procsubs != NULL) {
+        fflush(state->out);
+        wait_procsubs(cmd, state);
+    }
+    
     state->last_exit_status = result;
     return result;
 }
 
+/* Run a builtin started with & in a forked child, so the shell does not
+ * wait for it (cat, timeout, forall... can take any time). As in any
+ * shell, what it would change in the shell itself is lost with the child */
+static int execute_builtin_background(command_t *cmd, shell_state_t *state)
+{
+    job_throttle(state);
+    int cpu = job_pick_cpu(state);
+    output_tap_t tap;
+    int tapped = outmux_wanted() && outmux_tap(state, cmd, &tap) == 0;
+    
+    fflush(stdout);
+    fflush(state->out);
+    pid_t pid = fork();
+    if (pid == 0) {
+        /* The zygote's socket stays the parent's; the child forks itself */
+        state->zygote = NULL;
+        state->exec_tail = 0;
+        if (cpu >= 0) {
+            pin_to_cpu(0, cpu);
+        }
+        int result = execute_builtin(cmd, state);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(result);
+    }
+    if (pid < 0) {
+        print_error();
+        if (tapped) outmux_attach(state, cmd, &tap, 0, -1);
+        state->last_exit_status = 1;
+        return 1;
+    }
+    state->metrics.forks++;
+    
+    track_background(state, cmd, pid, cpu, tapped ? &tap : NULL);
+    return 0;
+}
+
 /* Execute command chain */
-/* Execute command chain */
-static int execute_chain(command_t *cmd, shell_state_t *state)
+int execute_chain(command_t *cmd, shell_state_t *state)
 {
     command_t *current = cmd;
     int result = 0;
     
+    /* time CHAIN reports on the rest of the chain */
+    if (cmd != NULL && cmd->args[0] != NULL && strcmp(cmd->args[0], "time") == 0) {
+        return execute_timed(cmd, state);
+    }
+    
     while (current != NULL && !state->exit_requested) {
         if (current->args[0] == NULL) {
             /* Empty command */
             result = 0;
         } else if (is_builtin(current->args[0])) {
-            result = execute_builtin(current, state);
+            result = current->background ? execute_builtin_background(current, state) :
+                execute_builtin(current, state);
         } else {
             result = execute_external(current, state);
         }
@@ -149,6 +442,7 @@ static int execute_chain(command_t *cmd, shell_state_t *state)
         if (current->background) {
             return result;  /* Don't wait for next commands */
         }
+        metrics_add_status(state, result);
         
         /* Handle operators */
         switch (current->next_op) {
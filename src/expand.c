@@ -1,5 +1,4 @@
 #include "../include/shell.h"
-#include <limits.h>
 
 /* Helper function to convert pid_t to string */
 static char *pid_to_string(pid_t pid)
@@ -22,6 +21,11 @@ static char *expand_single_var(const char *var_name, shell_state_t *state)
         /* Shell PID */
         return my_strdup(pid_to_string(state->shell_pid));
     }
+    else if (strcmp(var_name, "!") == 0) {
+        /* Last background PID */
+        if (state->last_bg_pid == 0) return my_strdup("");
+        return my_strdup(pid_to_string(state->last_bg_pid));
+    }
     else if (strcmp(var_name, "HOME") == 0) {
         /* Home directory */
         return my_strdup(state->home);
@@ -35,7 +39,12 @@ static char *expand_single_var(const char *var_name, shell_state_t *state)
         return my_strdup(state->oldpwd);
     }
     else {
-        /* Environment variable */
+        /* Shell variable, then environment variable */
+        const char *shell_value = get_shell_var(state, var_name);
+        if (shell_value) {
+            return my_strdup(shell_value);
+        }
+        
         char *env_value = getenv(var_name);
         if (env_value) {
             return my_strdup(env_value);
@@ -51,25 +60,49 @@ char *expand_variables(char *arg, shell_state_t *state)
 {
     if (!arg) return NULL;
     
-    /* Check if argument contains any $ */
-    if (strchr(arg, '$') == NULL) {
+    /* Check if argument contains any $ or backquote */
+    if (strchr(arg, '$') == NULL && strchr(arg, '`') == NULL) {
         return my_strdup(arg);
     }
     
-    /* Calculate maximum possible expanded size */
-    size_t max_expansion = strlen(arg) * 2 + PATH_MAX + 20;
-    char *result = malloc(max_expansion);
-    if (!result) {
-        print_error();
-        return NULL;
-    }
+    /* Substitutions can produce any amount of text, so grow as needed */
+    buffer_t result;
+    buf_init(&result);
     
     char *src = arg;
-    char *dest = result;
     
     while (*src) {
-        if (src[0] == '$' && (isalnum((unsigned char)src[1]) || 
-                              src[1] == '?' || src[1] == '$' || src[1] == '_')) {
+        if ((src[0] == '$' && src[1] == '(') || src[0] == '`') {
+            /* Command substitution */
+            char *end = skip_substitution(src);
+            if (end == NULL) {
+                /* Unterminated - keep the rest literally */
+                buf_append(&result, src, strlen(src));
+                break;
+            }
+            
+            size_t open_len = (src[0] == '`') ? 1 : 2;
+            size_t inner_len = (end - src) - open_len - 1;
+            char *inner = malloc(inner_len + 1);
+            if (!inner) {
+                print_error();
+                buf_free(&result);
+                return NULL;
+            }
+            memcpy(inner, src + open_len, inner_len);
+            inner[inner_len] = '\0';
+            
+            char *output = command_substitute(inner, state);
+            free(inner);
+            if (output) {
+                buf_append(&result, output, strlen(output));
+                free(output);
+            }
+            src = end;
+        }
+        else if (src[0] == '$' && (isalnum((unsigned char)src[1]) || 
+                              src[1] == '?' || src[1] == '$' || src[1] == '!' ||
+                              src[1] == '_')) {
             /* Found a variable */
             src++; /* Skip $ */
             
@@ -82,8 +115,8 @@ char *expand_variables(char *arg, shell_state_t *state)
                 var_name[1] = '\0';
                 src++;
             }
-            else if (*src == '$') {
-                var_name[0] = '$';
+            else if (*src == '$' || *src == '!') {
+                var_name[0] = *src;
                 var_name[1] = '\0';
                 src++;
             }
@@ -101,27 +134,17 @@ char *expand_variables(char *arg, shell_state_t *state)
             /* Expand the variable */
             char *expanded = expand_single_var(var_name, state);
             if (expanded) {
-                strcpy(dest, expanded);
-                dest += strlen(expanded);
+                buf_append(&result, expanded, strlen(expanded));
                 free(expanded);
             }
         }
-        else if (src[0] == '$' && src[1] == '{') {
-            /* Handle ${VAR} syntax - skip for now or implement similarly */
-            /* Skip to next character for now */
-            *dest++ = *src++;
-        }
         else {
-            /* Regular character */
-            *dest++ = *src++;
+            /* Literal text up to the next $ or backquote (${ is kept as-is) */
+            size_t run = 1 + strcspn(src + 1, "$`");
+            buf_append(&result, src, run);
+            src += run;
         }
     }
     
-    *dest = '\0';
-    
-    /* Trim the result to actual size */
-    char *final_result = my_strdup(result);
-    free(result);
-    
-    return final_result;
+    return buf_release(&result);
 }
\ No newline at end of file
@@ -0,0 +1,312 @@
+/* src/forall.c - forall builtin: run a command once per item, in parallel
+ *
+ *     forall [-j N] [-k] VAR in ITEM... -- COMMAND [ARG...]
+ *     forall [-j N] [-k] VAR -- COMMAND [ARG...]     (items: stdin lines)
+ *
+ * forall is flagged BUILTIN_DEFER_ARGS, so the parser leaves the words
+ * after -- unexpanded (see parser.c); they are split once, and for each
+ * item VAR is set and the words expanded again, except those that were
+ * single-quoted. Up to N instances (default: the online CPUs) run at
+ * once; the shell sleeps in poll() on their pidfds until one exits.
+ * Output goes straight to stdout, interleaved as the instances write
+ * it, or with -k into a memfd per item, copied to stdout in item order.
+ * The status is 0 if every instance succeeded, else the first failure's
+ * (in item order); $FORALL_STATUS lists them all.
+ */
+
+#include "../include/shell.h"
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/pidfd.h>
+#include <sys/sendfile.h>
+
+/* One item's instance */
+typedef struct instance_s {
+    pid_t pid;                  /* 0 until started, -1 once reaped */
+    int pidfd;                  /* Readable when it exits, or -1 */
+    int outfd;                  /* Its buffered output (-k), or -1 */
+    int status;
+} instance_t;
+
+/* Items from stdin, one per non-empty line */
+static char **read_items(int *count)
+{
+    buffer_t text;
+    char chunk[8192];
+    ssize_t n;
+
+    buf_init(&text);
+    while ((n = read(STDIN_FILENO, chunk, sizeof(chunk))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        buf_append(&text, chunk, n);
+    }
+
+    int capacity = 16;
+    char **items = malloc(capacity * sizeof(char *));
+    *count = 0;
+    for (char *line = text.data; items != NULL && line != NULL && *line != '\0'; ) {
+        char *nl = strchr(line, '\n');
+        if (nl != NULL) *nl = '\0';
+        if (*line != '\0') {
+            if (*count + 1 >= capacity) {
+                capacity *= 2;
+                char **grown = realloc(items, capacity * sizeof(char *));
+                if (grown == NULL) break;
+                items = grown;
+            }
+            items[(*count)++] = my_strdup(line);
+        }
+        line = nl ? nl + 1 : NULL;
+    }
+    if (items != NULL) items[*count] = NULL;
+    buf_free(&text);
+    return items;
+}
+
+/* Copy a finished instance's output to stdout */
+static void emit_output(int fd)
+{
+    off_t offset = 0;
+    struct stat st;
+
+    if (fstat(fd, &st) != 0) return;
+    while (offset < st.st_size) {
+        ssize_t n = sendfile(STDOUT_FILENO, fd, &offset, st.st_size - offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n > 0) continue;
+
+        /* sendfile() cannot write to this stdout: copy by hand */
+        char buf[8192];
+        while ((n = pread(fd, buf, sizeof(buf), offset)) > 0) {
+            if (write(STDOUT_FILENO, buf, n) != n) break;
+            offset += n;
+        }
+        break;
+    }
+}
+
+/* Start the instance for one item; returns its pid or -1. literal
+ * marks the template words that stay as written */
+static pid_t start_instance(shell_state_t *state, char **template,
+    const unsigned char *literal, instance_t *inst, int ordered)
+{
+    char *args[MAX_ARGS];
+    int argc = 0;
+
+    for (; template[argc] != NULL && argc < MAX_ARGS - 1; argc++) {
+        args[argc] = literal != NULL && literal[argc] ? my_strdup(template[argc]) :
+            expand_variables(template[argc], state);
+        if (args[argc] == NULL) args[argc] = my_strdup("");
+    }
+    args[argc] = NULL;
+
+    command_t sub;
+    memset(&sub, 0, sizeof(sub));
+    sub.args = args;
+    sub.next_op = OP_NONE;
+
+    /* Builtins run here and now, their output in line */
+    if (is_builtin(args[0])) {
+        inst->status = execute_builtin(&sub, state);
+        fflush(state->out);
+        inst->pid = -1;
+        for (int i = 0; i < argc; i++) free(args[i]);
+        return -1;
+    }
+
+    /* The child inherits the shell's stdout: point it at the memfd */
+    int saved = -1;
+    fflush(stdout);
+    if (ordered) {
+        inst->outfd = memfd_create("forall", MFD_CLOEXEC);
+        saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+        if (inst->outfd >= 0 && saved >= 0) {
+            dup2(inst->outfd, STDOUT_FILENO);
+        }
+    }
+
+    pid_t pid = spawn_external(&sub, state);
+
+    if (saved >= 0) {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+    for (int i = 0; i < argc; i++) free(args[i]);
+
+    if (pid < 0) {
+        inst->status = state->last_exit_status;
+        inst->pid = -1;
+        return -1;
+    }
+    inst->pid = pid;
+    inst->pidfd = (int)pidfd_open(pid, 0);
+    return pid;
+}
+
+/* Reap an instance that has exited (or block until it does) */
+static void reap_instance(shell_state_t *state, instance_t *inst)
+{
+    int status;
+
+    while (wait_child(state, inst->pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            status = 1 << 8;
+            break;
+        }
+    }
+    inst->status = exit_code(status);
+    inst->pid = -1;
+    if (inst->pidfd >= 0) {
+        close(inst->pidfd);
+        inst->pidfd = -1;
+    }
+}
+
+/* Wait until at least one running instance has exited, and reap it */
+static void wait_any(shell_state_t *state, instance_t *insts, int first, int last)
+{
+    struct pollfd fds[last - first];
+    int index[last - first];
+    int n = 0;
+
+    for (int i = first; i < last; i++) {
+        if (insts[i].pid <= 0) continue;
+        if (insts[i].pidfd < 0) {
+            /* No pidfd (e.g. the zygote reaped it already): just wait */
+            reap_instance(state, &insts[i]);
+            return;
+        }
+        fds[n].fd = insts[i].pidfd;
+        fds[n].events = POLLIN;
+        index[n++] = i;
+    }
+    if (n == 0) return;
+
+    while (poll(fds, n, -1) < 0) {
+        if (errno != EINTR) return;
+    }
+    for (int k = 0; k < n; k++) {
+        if (fds[k].revents != 0) reap_instance(state, &insts[index[k]]);
+    }
+}
+
+/* Built-in: forall [-j N] [-k] VAR [in ITEM...] -- COMMAND [ARG...] */
+int builtin_forall(command_t *cmd, shell_state_t *state)
+{
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int ordered = 0;
+    int i = 1;
+
+    for (; cmd->args[i] != NULL && cmd->args[i][0] == '-' &&
+        strcmp(cmd->args[i], "--") != 0; i++) {
+        if (strcmp(cmd->args[i], "-k") == 0) {
+            ordered = 1;
+        } else if (strcmp(cmd->args[i], "-j") == 0 && cmd->args[i + 1] != NULL) {
+            jobs = atol(cmd->args[++i]);
+        } else {
+            jobs = 0;
+            break;
+        }
+    }
+
+    const char *var = cmd->args[i];
+    char **items = NULL;
+    char **template = NULL;
+    const unsigned char *literal = NULL;
+    int count = 0;
+    int from_stdin = 0;
+
+    if (var != NULL && cmd->args[i + 1] != NULL && strcmp(cmd->args[i + 1], "in") == 0) {
+        items = &cmd->args[i + 2];
+    } else if (var != NULL && cmd->args[i + 1] != NULL && strcmp(cmd->args[i + 1], "--") == 0) {
+        from_stdin = 1;
+    }
+    for (int j = i + 1; var != NULL && cmd->args[j] != NULL; j++) {
+        if (strcmp(cmd->args[j], "--") == 0) {
+            template = &cmd->args[j + 1];
+            if (cmd->literal != NULL) literal = &cmd->literal[j + 1];
+            if (items != NULL) count = &cmd->args[j] - items;
+            break;
+        }
+    }
+
+    if (jobs < 1 || var == NULL || strcmp(var, "--") == 0 || (items == NULL && !from_stdin) ||
+        template == NULL || template[0] == NULL) {
+        fprintf(stderr, "forall: usage: forall [-j N] [-k] VAR [in ITEM...] -- command [args...]\n");
+        return 1;
+    }
+    if (from_stdin) {
+        items = read_items(&count);
+        if (items == NULL) {
+            print_error();
+            return 1;
+        }
+    }
+
+    instance_t *insts = calloc(count ? count : 1, sizeof(instance_t));
+    if (insts == NULL) {
+        if (from_stdin) free_string_array(items);
+        print_error();
+        return 1;
+    }
+    for (int k = 0; k < count; k++) {
+        insts[k].pidfd = insts[k].outfd = -1;
+    }
+
+    /* Instances must come back to us */
+    int exec_tail = state->exec_tail;
+    state->exec_tail = 0;
+    fflush(state->out);
+
+    int next = 0;               /* Next item to start */
+    int emitted = 0;            /* Items whose output is out (-k) */
+    int running = 0;
+    while ((next < count || running > 0) && !state->exit_requested) {
+        while (next < count && running < jobs) {
+            set_shell_var(state, var, items[next]);
+            if (start_instance(state, template, literal, &insts[next], ordered) > 0) {
+                running++;
+            }
+            next++;
+        }
+        if (running > 0) {
+            wait_any(state, insts, emitted, next);
+            running = 0;
+            for (int k = emitted; k < next; k++) {
+                if (insts[k].pid > 0) running++;
+            }
+        }
+
+        /* Output of finished items, in order, up to the first still running */
+        for (; emitted < next && insts[emitted].pid <= 0; emitted++) {
+            if (insts[emitted].outfd >= 0) {
+                emit_output(insts[emitted].outfd);
+                close(insts[emitted].outfd);
+                insts[emitted].outfd = -1;
+            }
+        }
+    }
+
+    /* Combined status: the first failure, and every status in a list */
+    int result = 0;
+    buffer_t statuses;
+    buf_init(&statuses);
+    for (int k = 0; k < count; k++) {
+        char num[16];
+        if (insts[k].pid > 0) reap_instance(state, &insts[k]);
+        if (insts[k].outfd >= 0) close(insts[k].outfd);
+        if (result == 0) result = insts[k].status;
+        int len = snprintf(num, sizeof(num), k ? " %d" : "%d", insts[k].status);
+        buf_append(&statuses, num, len);
+    }
+    set_shell_var(state, "FORALL_STATUS", statuses.data ? statuses.data : "");
+    buf_free(&statuses);
+
+    state->exec_tail = exec_tail;
+    free(insts);
+    if (from_stdin) free_string_array(items);
+    return result;
+}
\ No newline at end of file
@@ -0,0 +1,351 @@
+/* src/history.c - Persistent command history
+ *
+ * Lines entered at the terminal are appended to $OSHELL_HISTFILE
+ * (default ~/.oshell_history), one per line, under flock() so shells
+ * sharing the file never interleave a line. The file is mapped, not
+ * read, and adding a line only appends it: nothing is parsed until
+ * history is first listed, browsed or searched, and even then only
+ * line starts are found.
+ *
+ * Reverse search uses a trigram filter. Entries are grouped in blocks
+ * of HIST_BLOCK, and each block has a bitmap of the (hashed) trigrams
+ * its entries contain. A query rules out every block that lacks one of
+ * its trigrams with a few word ANDs, so only candidate blocks are
+ * searched with memmem(). The bitmaps are built on the first search.
+ */
+
+#include "../include/shell.h"
+#include <limits.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#define HIST_BLOCK 32                   /* Entries per bitmap */
+#define HIST_BITS 4096                  /* Trigram hash buckets */
+#define HIST_WORDS (HIST_BITS / 64)
+
+typedef struct hist_entry_s {
+    const char *text;                   /* In the mapping or owned */
+    size_t len;
+} hist_entry_t;
+
+struct history_s {
+    int fd;                             /* Open for appending, or -1 */
+    char *map;                          /* The file as it was opened */
+    size_t map_len;
+    int scanned;                        /* Line starts found yet? */
+    hist_entry_t *entries;              /* Until scanned, only those added */
+    int count;
+    int capacity;
+    int owned_from;                     /* Entries added since: owned text */
+    uint64_t (*bitmaps)[HIST_WORDS];    /* One per block, once built */
+    int blocks;
+};
+
+/* Bucket of the trigram starting at s */
+static unsigned trigram(const char *s)
+{
+    uint32_t t = (unsigned char)s[0] | (unsigned char)s[1] << 8 |
+        (unsigned char)s[2] << 16;
+    return (t * 2654435761u) >> 20 & (HIST_BITS - 1);
+}
+
+static int push_entry(struct history_s *h, const char *text, size_t len)
+{
+    if (h->count >= h->capacity) {
+        int capacity = h->capacity ? h->capacity * 2 : 1024;
+        hist_entry_t *grown = realloc(h->entries, capacity * sizeof(hist_entry_t));
+        if (grown == NULL) return -1;
+        h->entries = grown;
+        h->capacity = capacity;
+    }
+    h->entries[h->count].text = text;
+    h->entries[h->count].len = len;
+    h->count++;
+    return 0;
+}
+
+/* Set the bits of entry i's trigrams in its block's bitmap */
+static int index_entry(struct history_s *h, int i)
+{
+    int block = i / HIST_BLOCK;
+
+    if (block >= h->blocks) {
+        int blocks = block + block / 8 + 16;
+        uint64_t (*grown)[HIST_WORDS] = realloc(h->bitmaps, blocks * sizeof(*grown));
+        if (grown == NULL) return -1;
+        memset(grown + h->blocks, 0, (blocks - h->blocks) * sizeof(*grown));
+        h->bitmaps = grown;
+        h->blocks = blocks;
+    }
+
+    const hist_entry_t *e = &h->entries[i];
+    for (size_t j = 0; j + 3 <= e->len; j++) {
+        unsigned bit = trigram(e->text + j);
+        h->bitmaps[block][bit / 64] |= (uint64_t)1 << (bit % 64);
+    }
+    return 0;
+}
+
+/* Find the line starts in the mapping; lines added before that go
+ * after them */
+static void scan_entries(struct history_s *h)
+{
+    const char *p = h->map;
+    const char *end = h->map + h->map_len;
+    hist_entry_t *added = h->entries;
+    int added_count = h->count;
+
+    h->scanned = 1;
+    h->entries = NULL;
+    h->count = h->capacity = 0;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', end - p);
+        size_t len = nl ? (size_t)(nl - p) : (size_t)(end - p);
+        if (len > 0 && push_entry(h, p, len) != 0) break;
+        p += len + 1;
+    }
+    h->owned_from = h->count;
+
+    for (int i = 0; i < added_count; i++) {
+        if (push_entry(h, added[i].text, added[i].len) != 0) {
+            free((char *)added[i].text);
+        }
+    }
+    free(added);
+}
+
+/* The newest entry, without scanning for it; NULL if there is none */
+static const char *last_entry(struct history_s *h, size_t *len)
+{
+    if (h->count > 0) {
+        *len = h->entries[h->count - 1].len;
+        return h->entries[h->count - 1].text;
+    }
+    if (h->scanned) return NULL;
+
+    /* The mapping's last non-empty line */
+    const char *end = h->map + h->map_len;
+    while (end > h->map && end[-1] == '\n') end--;
+    if (end == h->map) return NULL;
+    const char *start = memrchr(h->map, '\n', end - h->map);
+    start = start ? start + 1 : h->map;
+    *len = end - start;
+    return start;
+}
+
+/* Path of the history file; -1 if history is not kept */
+static int history_path(char *path, size_t size)
+{
+    const char *file = getenv("OSHELL_HISTFILE");
+    const char *home;
+
+    if (file != NULL) {
+        if (*file == '\0') return -1;
+        snprintf(path, size, "%s", file);
+    } else if ((home = getenv("HOME")) != NULL) {
+        snprintf(path, size, "%s/.oshell_history", home);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* The history, opened and mapped on first use */
+static struct history_s *get_history(shell_state_t *state)
+{
+    struct history_s *h = state->history;
+    char path[PATH_MAX];
+    struct stat st;
+
+    if (h != NULL) return h;
+    h = calloc(1, sizeof(struct history_s));
+    if (h == NULL) return NULL;
+    h->fd = -1;
+    state->history = h;
+
+    if (history_path(path, sizeof(path)) != 0) return h;
+    h->fd = move_fd_high(open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600));
+    if (h->fd < 0) return h;
+
+    if (fstat(h->fd, &st) == 0 && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, h->fd, 0);
+        if (map != MAP_FAILED) {
+            h->map = map;
+            h->map_len = st.st_size;
+        }
+    }
+    return h;
+}
+
+/* The history with its line starts found */
+static struct history_s *scanned_history(shell_state_t *state)
+{
+    struct history_s *h = get_history(state);
+    if (h != NULL && !h->scanned) scan_entries(h);
+    return h;
+}
+
+/* Number of entries */
+int history_count(shell_state_t *state)
+{
+    struct history_s *h = scanned_history(state);
+    return h != NULL ? h->count : 0;
+}
+
+/* Entry i (0 is the oldest); not NUL-terminated */
+const char *history_get(shell_state_t *state, int i, size_t *len)
+{
+    struct history_s *h = scanned_history(state);
+
+    if (h == NULL || i < 0 || i >= h->count) return NULL;
+    *len = h->entries[i].len;
+    return h->entries[i].text;
+}
+
+/* Record a line, appending it to the file */
+void history_add(shell_state_t *state, const char *line)
+{
+    size_t len = strlen(line);
+    struct history_s *h = get_history(state);
+    size_t last_len;
+    const char *last;
+
+    if (h == NULL || len == 0 || strchr(line, '\n') != NULL) return;
+
+    /* Repeating the previous line adds nothing */
+    last = last_entry(h, &last_len);
+    if (last != NULL && last_len == len && memcmp(last, line, len) == 0) {
+        return;
+    }
+
+    char *text = my_strdup(line);
+    if (text == NULL || push_entry(h, text, len) != 0) {
+        free(text);
+        return;
+    }
+    if (h->bitmaps != NULL) index_entry(h, h->count - 1);
+
+    if (h->fd >= 0 && flock(h->fd, LOCK_EX) == 0) {
+        struct iovec iov[2] = {
+            { .iov_base = text, .iov_len = len },
+            { .iov_base = "\n", .iov_len = 1 },
+        };
+        if (writev(h->fd, iov, 2) < 0) {
+            print_error();
+        }
+        flock(h->fd, LOCK_UN);
+    }
+}
+
+/* Newest entry before entry `before` containing query, or -1 */
+int history_search(shell_state_t *state, const char *query, int before)
+{
+    size_t qlen = strlen(query);
+    struct history_s *h = scanned_history(state);
+    int count = h != NULL ? h->count : 0;
+
+    if (count == 0) return -1;
+    if (before > count) before = count;
+
+    /* Trigrams of the query; shorter queries match every block */
+    uint64_t want[HIST_WORDS];
+    int words[HIST_WORDS];
+    int nwords = 0;
+    memset(want, 0, sizeof(want));
+    if (qlen >= 3) {
+        if (h->bitmaps == NULL) {
+            for (int i = 0; i < count; i++) {
+                if (index_entry(h, i) != 0) break;
+            }
+        }
+        for (size_t j = 0; j + 3 <= qlen; j++) {
+            unsigned bit = trigram(query + j);
+            want[bit / 64] |= (uint64_t)1 << (bit % 64);
+        }
+        for (int w = 0; w < HIST_WORDS; w++) {
+            if (want[w] != 0) words[nwords++] = w;
+        }
+    }
+
+    int i = before - 1;
+    while (i >= 0) {
+        int block = i / HIST_BLOCK;
+
+        if (qlen >= 3 && block < h->blocks) {
+            int miss = 0;
+            for (int k = 0; k < nwords && !miss; k++) {
+                int w = words[k];
+                miss = (h->bitmaps[block][w] & want[w]) != want[w];
+            }
+            if (miss) {
+                i = block * HIST_BLOCK - 1;
+                continue;
+            }
+        }
+
+        for (int first = block * HIST_BLOCK; i >= first; i--) {
+            if (memmem(h->entries[i].text, h->entries[i].len, query, qlen) != NULL) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+/* Built-in: history [N] | history -s TEXT - list the last N entries
+ * (default 16), or those containing TEXT, newest first */
+int builtin_history(command_t *cmd, shell_state_t *state)
+{
+    int count = history_count(state);
+    size_t len;
+    const char *text;
+
+    if (cmd->args[1] != NULL && strcmp(cmd->args[1], "-s") == 0) {
+        if (cmd->args[2] == NULL) {
+            fprintf(stderr, "history: usage: history [N] | history -s TEXT\n");
+            return 1;
+        }
+        int found = 0;
+        for (int i = history_search(state, cmd->args[2], count); i >= 0;
+            i = history_search(state, cmd->args[2], i)) {
+            text = history_get(state, i, &len);
+            fprintf(state->out, "%5d  %.*s\n", i + 1, (int)len, text);
+            found = 1;
+        }
+        return found ? 0 : 1;
+    }
+
+    int n = 16;
+    if (cmd->args[1] != NULL) {
+        char *end;
+        n = (int)strtol(cmd->args[1], &end, 10);
+        if (*end != '\0' || n < 0) {
+            fprintf(stderr, "history: %s: invalid count\n", cmd->args[1]);
+            return 1;
+        }
+    }
+
+    for (int i = count > n ? count - n : 0; i < count; i++) {
+        text = history_get(state, i, &len);
+        fprintf(state->out, "%5d  %.*s\n", i + 1, (int)len, text);
+    }
+    return 0;
+}
+
+/* Unmap the file and free what was added */
+void history_free(shell_state_t *state)
+{
+    struct history_s *h = state->history;
+    if (h == NULL) return;
+
+    for (int i = h->owned_from; i < h->count; i++) {
+        free((char *)h->entries[i].text);
+    }
+    free(h->entries);
+    free(h->bitmaps);
+    if (h->map != NULL) munmap(h->map, h->map_len);
+    if (h->fd >= 0) close(h->fd);
+    free(h);
+    state->history = NULL;
+}
\ No newline at end of file
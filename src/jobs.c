@@ -0,0 +1,302 @@
+/* src/jobs.c - Table of child processes the shell still has to reap */
+
+#include "../include/shell.h"
+#include <sched.h>
+
+#define DONE_JOBS_MAX 64            /* Finished jobs kept for `jobs` */
+
+/* Start tracking a child */
+job_t *job_add(shell_state_t *state, pid_t pid, const char *command)
+{
+    job_t *job = calloc(1, sizeof(job_t));
+    if (job == NULL) return NULL;
+
+    job->id = ++state->next_job_id;
+    job->pid = pid;
+    job->command = my_strdup(command ? command : "");
+    job->cpu = -1;
+
+    /* Keep the list in start order */
+    job_t **tail = &state->jobs;
+    while (*tail != NULL) {
+        tail = &(*tail)->next;
+    }
+    *tail = job;
+    return job;
+}
+
+/* Unlink the job for pid. A background job that has finished (usage is
+ * not NULL) is kept, with its status and usage, until `jobs` shows it */
+static void job_remove(shell_state_t *state, pid_t pid, int status,
+    const struct rusage *usage)
+{
+    for (job_t **link = &state->jobs; *link != NULL; link = &(*link)->next) {
+        if ((*link)->pid == pid) {
+            job_t *job = *link;
+            *link = job->next;
+            if (!job->background) {
+                free(job->command);
+                free(job);
+                break;
+            }
+            state->metrics.jobs_reaped++;
+            if (usage == NULL) {
+                free(job->command);
+                free(job);
+                break;
+            }
+
+            /* Kept in finishing order; the oldest goes past DONE_JOBS_MAX */
+            job->status = status;
+            job->usage = *usage;
+            job->next = NULL;
+            int count = 1;
+            job_t **tail = &state->done_jobs;
+            for (; *tail != NULL; tail = &(*tail)->next) count++;
+            *tail = job;
+            if (count > DONE_JOBS_MAX) {
+                job_t *oldest = state->done_jobs;
+                state->done_jobs = oldest->next;
+                free(oldest->command);
+                free(oldest);
+            }
+            break;
+        }
+    }
+
+    if (state->jobs == NULL && state->done_jobs == NULL) {
+        state->next_job_id = 0;
+    }
+}
+
+/* Convert a wait status into a shell exit status */
+int exit_code(int status)
+{
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return 1;
+}
+
+/* waitpid() that also covers children spawned through the zygote. A
+ * reaped child's resource usage goes into the shell's totals and, if
+ * usage is not NULL, is stored there */
+pid_t wait_child_usage(shell_state_t *state, pid_t pid, int *status, int options,
+    struct rusage *usage)
+{
+    struct rusage child;
+    pid_t result;
+
+    memset(&child, 0, sizeof(child));
+    if (zygote_owns(state, pid)) {
+        result = zygote_wait(state, pid, status, options, &child);
+    } else {
+        result = wait4(pid, status, options, &child);
+    }
+
+    if (result > 0) {
+        usage_add(state, &child);
+        if (usage != NULL) *usage = child;
+    }
+    return result;
+}
+
+/* wait_child_usage() for callers that only want the status */
+pid_t wait_child(shell_state_t *state, pid_t pid, int *status, int options)
+{
+    return wait_child_usage(state, pid, status, options, NULL);
+}
+
+/* Wait for a tracked child and return its exit status */
+int job_wait(shell_state_t *state, pid_t pid)
+{
+    struct rusage usage;
+    int status;
+
+    while (wait_child_usage(state, pid, &status, 0, &usage) < 0) {
+        if (errno != EINTR) {
+            job_remove(state, pid, 1, NULL);
+            return 1;
+        }
+    }
+
+    job_remove(state, pid, exit_code(status), &usage);
+    return exit_code(status);
+}
+
+/* Reap finished children without blocking */
+void jobs_reap(shell_state_t *state)
+{
+    job_t *job = state->jobs;
+
+    while (job != NULL) {
+        job_t *next = job->next;
+        struct rusage usage;
+        int status;
+
+        if (wait_child_usage(state, job->pid, &status, WNOHANG, &usage) == job->pid) {
+            job_remove(state, job->pid, exit_code(status), &usage);
+        }
+        job = next;
+    }
+}
+
+/* Drop the finished jobs once `jobs` has shown them */
+void jobs_forget_done(shell_state_t *state)
+{
+    while (state->done_jobs != NULL) {
+        job_t *job = state->done_jobs;
+        state->done_jobs = job->next;
+        free(job->command);
+        free(job);
+    }
+    if (state->jobs == NULL) {
+        state->next_job_id = 0;
+    }
+}
+
+/* Background jobs still running (as of the last reap) */
+static int background_count(shell_state_t *state)
+{
+    int count = 0;
+
+    for (job_t *job = state->jobs; job != NULL; job = job->next) {
+        if (job->background) count++;
+    }
+    return count;
+}
+
+/* Block until some child may have exited; -1 if there is none */
+static int wait_for_exit(shell_state_t *state)
+{
+    siginfo_t info;
+
+    /* Zygote children are reported over its socket; poll it briefly so
+     * children the shell forked itself are noticed too */
+    if (state->zygote != NULL) {
+        zygote_poll(state, 10);
+        return 0;
+    }
+
+    /* Leave the child for jobs_reap() to collect */
+    while (waitid(P_ALL, 0, &info, WEXITED | WNOWAIT) < 0) {
+        if (errno != EINTR) return -1;
+    }
+
+    /* A child nobody tracks would keep waking us */
+    int tracked = 0;
+    for (job_t *job = state->jobs; job != NULL; job = job->next) {
+        if (job->pid == info.si_pid) tracked = 1;
+    }
+    if (!tracked) {
+        wait_child(state, info.si_pid, NULL, 0);
+    }
+    return 0;
+}
+
+/* Hold a new background job until fewer than $OSHELL_MAX_JOBS run */
+void job_throttle(shell_state_t *state)
+{
+    const char *value = getenv("OSHELL_MAX_JOBS");
+    int limit = value ? atoi(value) : 0;
+    if (limit <= 0) return;
+
+    jobs_reap(state);
+    if (background_count(state) >= limit) {
+        state->jobs_queued++;
+    }
+    while (background_count(state) >= limit) {
+        if (wait_for_exit(state) != 0) break;
+        jobs_reap(state);
+    }
+}
+
+/* Learn which CPUs the shell itself may use */
+static int load_cpus(shell_state_t *state)
+{
+    cpu_set_t set;
+
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return -1;
+
+    int count = CPU_COUNT(&set);
+    state->cpus = calloc(count, sizeof(int));
+    state->cpu_assigned = calloc(count, sizeof(long));
+    if (state->cpus == NULL || state->cpu_assigned == NULL) {
+        free(state->cpus);
+        free(state->cpu_assigned);
+        state->cpus = NULL;
+        state->cpu_assigned = NULL;
+        return -1;
+    }
+
+    for (int cpu = 0; cpu < CPU_SETSIZE && state->cpu_count < count; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            state->cpus[state->cpu_count++] = cpu;
+        }
+    }
+    return 0;
+}
+
+/* Choose a CPU for a new background job per $OSHELL_CPU_AFFINITY
+ * ("round-robin" or "least-loaded"); -1 leaves it unpinned */
+int job_pick_cpu(shell_state_t *state)
+{
+    const char *policy = getenv("OSHELL_CPU_AFFINITY");
+    int slot;
+
+    if (policy == NULL || *policy == '\0' || strcmp(policy, "off") == 0) {
+        return -1;
+    }
+    if (state->cpu_count == 0 && load_cpus(state) != 0) {
+        return -1;
+    }
+
+    if (strcmp(policy, "round-robin") == 0) {
+        slot = state->next_cpu++ % state->cpu_count;
+    } else if (strcmp(policy, "least-loaded") == 0) {
+        /* Fewest running jobs pinned to it; ties go to the lowest */
+        int best = -1;
+        slot = 0;
+        jobs_reap(state);
+        for (int i = 0; i < state->cpu_count; i++) {
+            int load = 0;
+            for (job_t *job = state->jobs; job != NULL; job = job->next) {
+                if (job->cpu == state->cpus[i]) load++;
+            }
+            if (best < 0 || load < best) {
+                best = load;
+                slot = i;
+            }
+        }
+    } else {
+        fprintf(stderr, "OSHELL_CPU_AFFINITY: unknown policy '%s'\n", policy);
+        return -1;
+    }
+
+    state->cpu_assigned[slot]++;
+    return state->cpus[slot];
+}
+
+/* Restrict pid (0 for the caller) to a single CPU */
+int pin_to_cpu(pid_t pid, int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(pid, sizeof(set), &set);
+}
+
+/* Forget all tracked children and scheduling state */
+void free_jobs(shell_state_t *state)
+{
+    while (state->jobs != NULL) {
+        job_remove(state, state->jobs->pid, 0, NULL);
+    }
+    jobs_forget_done(state);
+
+    free(state->cpus);
+    free(state->cpu_assigned);
+    state->cpus = NULL;
+    state->cpu_assigned = NULL;
+    state->cpu_count = 0;
+}
\ No newline at end of file
@@ -0,0 +1,182 @@
+/* src/journal.c - Checkpoint journal for batch runs
+ *
+ * With --journal FILE every executed script line appends a record
+ *
+ *     <line number> <FNV-1a hash of the line, hex> <exit status>
+ *
+ * to FILE. Records are written as soon as a line finishes, but fsync()
+ * is batched. With --resume the existing journal is loaded first and
+ * lines it shows as completed successfully, with the same text, are
+ * skipped. Lines that change the shell's own state (cd, setenv, ...)
+ * always run again, so later lines see the same environment.
+ */
+
+#include "../include/shell.h"
+#include <time.h>
+
+/* Sync after this many records or this long, whichever comes first */
+#define JOURNAL_SYNC_RECORDS 64
+#define JOURNAL_SYNC_MS 1000
+
+/* Outcome of a line in the previous run */
+typedef struct journal_entry_s {
+    uint64_t hash;
+    int status;
+    int present;
+} journal_entry_t;
+
+struct journal_s {
+    int fd;
+    journal_entry_t *done;      /* Indexed by line number (resume only) */
+    int done_count;
+    int unsynced;               /* Records written since the last fsync */
+    struct timespec last_sync;
+};
+
+/* Milliseconds from a to b */
+static long elapsed_ms(const struct timespec *a, const struct timespec *b)
+{
+    return (b->tv_sec - a->tv_sec) * 1000 + (b->tv_nsec - a->tv_nsec) / 1000000;
+}
+
+/* Load records of an earlier run; later records for a line win */
+static void journal_load(struct journal_s *j, const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) return;
+
+    int lineno;
+    unsigned long long hash;
+    int status;
+    while (fscanf(fp, "%d %llx %d", &lineno, &hash, &status) == 3) {
+        if (lineno <= 0) continue;
+
+        if (lineno >= j->done_count) {
+            int count = j->done_count ? j->done_count : 1024;
+            while (count <= lineno) count *= 2;
+            journal_entry_t *grown = realloc(j->done, count * sizeof(journal_entry_t));
+            if (grown == NULL) break;
+            memset(grown + j->done_count, 0,
+                (count - j->done_count) * sizeof(journal_entry_t));
+            j->done = grown;
+            j->done_count = count;
+        }
+        j->done[lineno].hash = hash;
+        j->done[lineno].status = status;
+        j->done[lineno].present = 1;
+    }
+    fclose(fp);
+}
+
+/* Open the journal, loading it first when resuming; without --resume
+ * a new run starts a new journal */
+int journal_open(shell_state_t *state, const char *path, int resume)
+{
+    struct journal_s *j = calloc(1, sizeof(struct journal_s));
+    if (j == NULL) return -1;
+
+    if (resume) {
+        journal_load(j, path);
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (resume ? 0 : O_TRUNC);
+    j->fd = open(path, flags, 0644);
+    if (j->fd < 0) {
+        free(j->done);
+        free(j);
+        return -1;
+    }
+
+    /* Keep it out of the way of user redirections */
+    j->fd = move_fd_high(j->fd);
+
+    clock_gettime(CLOCK_MONOTONIC, &j->last_sync);
+    state->journal = j;
+    return 0;
+}
+
+/* Does the line run a builtin that changes the shell itself (flagged
+ * BUILTIN_STATEFUL)? Checks the first word of every command in the
+ * chain, outside quotes */
+static int changes_state(const char *text)
+{
+    const char *p = text;
+
+    for (;;) {
+        while (*p == ' ' || *p == '\t') p++;
+
+        char word[64];
+        size_t len = strcspn(p, " \t;&|");
+        if (len < sizeof(word)) {
+            memcpy(word, p, len);
+            word[len] = '\0';
+            int flags = builtin_flags(word);
+            if (flags >= 0 && (flags & BUILTIN_STATEFUL)) return 1;
+        }
+
+        /* On to the next command */
+        char quote = 0;
+        for (; *p != '\0'; p++) {
+            if (quote) {
+                if (*p == quote) quote = 0;
+            } else if (*p == '\'' || *p == '"') {
+                quote = *p;
+            } else if (*p == ';' || *p == '&' || *p == '|') {
+                break;
+            }
+        }
+        if (*p == '\0') return 0;
+        while (*p == ';' || *p == '&' || *p == '|') p++;
+    }
+}
+
+/* Should this line be skipped because the previous run completed it? */
+int journal_skip(shell_state_t *state, int lineno, const char *text)
+{
+    struct journal_s *j = state->journal;
+
+    if (j == NULL || lineno <= 0 || lineno >= j->done_count) return 0;
+
+    journal_entry_t *e = &j->done[lineno];
+    return e->present && e->status == 0 &&
+        e->hash == hash_bytes(text, strlen(text)) && !changes_state(text);
+}
+
+/* Append a record for a finished line */
+void journal_record(shell_state_t *state, int lineno, const char *text, int status)
+{
+    struct journal_s *j = state->journal;
+    char record[64];
+
+    if (j == NULL) return;
+
+    int len = snprintf(record, sizeof(record), "%d %016llx %d\n", lineno,
+        (unsigned long long)hash_bytes(text, strlen(text)), status);
+    if (write(j->fd, record, len) != len) {
+        print_error();
+        return;
+    }
+
+    /* Batched durability: bounded records and time at risk */
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (++j->unsynced >= JOURNAL_SYNC_RECORDS ||
+        elapsed_ms(&j->last_sync, &now) >= JOURNAL_SYNC_MS) {
+        fdatasync(j->fd);
+        j->unsynced = 0;
+        j->last_sync = now;
+    }
+}
+
+/* Sync and close the journal */
+void journal_close(shell_state_t *state)
+{
+    struct journal_s *j = state->journal;
+    if (j == NULL) return;
+
+    fdatasync(j->fd);
+    close(j->fd);
+    free(j->done);
+    free(j);
+    state->journal = NULL;
+}
\ No newline at end of file
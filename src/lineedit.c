@@ -0,0 +1,418 @@
+/* src/lineedit.c - Line editor for interactive input
+ *
+ * Used in place of fgets() when both stdin and stdout are terminals.
+ * The terminal is put in raw mode only while a line is being edited.
+ * Keys: the usual cursor movement (arrows, Home/End, Ctrl-A/E/B/F),
+ * Backspace/Delete, Ctrl-U/K/W to kill, Ctrl-L to clear the screen,
+ * Ctrl-C to abandon the line, Ctrl-D for end of input on an empty line,
+ * Tab to complete the word before the cursor (see complete.c), Up/Down
+ * (Ctrl-P/N) to step through history and Ctrl-R to search it backwards
+ * (see history.c).
+ */
+
+#include "../include/shell.h"
+#include <termios.h>
+#include <sys/ioctl.h>
+
+/* Candidates listed before asking is not worth it */
+#define LIST_MAX 100
+
+typedef struct editor_s {
+    shell_state_t *state;
+    const char *prompt;
+    char buf[MAX_INPUT];
+    size_t len;
+    size_t pos;                 /* Cursor, 0..len */
+    int last_tab;               /* Previous key was an unproductive Tab */
+    int hist_index;             /* Entry shown, or -1 for the new line */
+    char *draft;                /* The new line, while browsing history */
+} editor_t;
+
+/* Write all of s to the terminal */
+static void term_write(const char *s, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = write(STDOUT_FILENO, s, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return;
+        s += w;
+        n -= w;
+    }
+}
+
+/* Next byte of input; -1 at end of input */
+static int read_key(void)
+{
+    unsigned char c;
+
+    for (;;) {
+        ssize_t n = read(STDIN_FILENO, &c, 1);
+        if (n == 1) return c;
+        if (n < 0 && errno == EINTR) continue;
+        return -1;
+    }
+}
+
+/* Redraw the prompt and line, with the cursor in place */
+static void refresh(editor_t *ed)
+{
+    buffer_t out;
+    char move[32];
+
+    buf_init(&out);
+    buf_append(&out, "\r", 1);
+    buf_append(&out, ed->prompt, strlen(ed->prompt));
+    buf_append(&out, ed->buf, ed->len);
+    buf_append(&out, "\x1b[K", 3);
+    if (ed->len > ed->pos) {
+        int n = snprintf(move, sizeof(move), "\x1b[%zuD", ed->len - ed->pos);
+        buf_append(&out, move, n);
+    }
+    term_write(out.data, out.len);
+    buf_free(&out);
+}
+
+/* Insert n bytes at the cursor */
+static int insert(editor_t *ed, const char *s, size_t n)
+{
+    if (ed->len + n >= sizeof(ed->buf)) return 0;
+    memmove(ed->buf + ed->pos + n, ed->buf + ed->pos, ed->len - ed->pos);
+    memcpy(ed->buf + ed->pos, s, n);
+    ed->len += n;
+    ed->pos += n;
+    return 1;
+}
+
+/* Delete the bytes in [from, to) */
+static void delete_range(editor_t *ed, size_t from, size_t to)
+{
+    memmove(ed->buf + from, ed->buf + to, ed->len - to);
+    ed->len -= to - from;
+    if (ed->pos > to) {
+        ed->pos -= to - from;
+    } else if (ed->pos > from) {
+        ed->pos = from;
+    }
+}
+
+/* Print candidates in columns below the line */
+static void list_candidates(char **matches, int total)
+{
+    size_t width = 0;
+    int shown = 0;
+
+    for (; matches[shown] != NULL && shown < LIST_MAX; shown++) {
+        size_t len = strlen(matches[shown]);
+        if (len > width) width = len;
+    }
+    width += 2;
+
+    struct winsize ws;
+    size_t cols = 80;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) {
+        cols = ws.ws_col;
+    }
+    size_t per_row = cols / width ? cols / width : 1;
+
+    buffer_t out;
+    buf_init(&out);
+    buf_append(&out, "\r\n", 2);
+    for (int i = 0; i < shown; i++) {
+        size_t len = strlen(matches[i]);
+        buf_append(&out, matches[i], len);
+        if ((i + 1) % per_row == 0 || i + 1 == shown) {
+            buf_append(&out, "\r\n", 2);
+        } else {
+            for (; len < width; len++) buf_append(&out, " ", 1);
+        }
+    }
+    if (total > shown) {
+        char more[64];
+        int n = snprintf(more, sizeof(more), "... and %d more\r\n", total - shown);
+        buf_append(&out, more, n);
+    }
+    term_write(out.data, out.len);
+    buf_free(&out);
+}
+
+/* Tab: complete the word before the cursor as far as it is unambiguous,
+ * or list the candidates when it already is */
+static void complete(editor_t *ed)
+{
+    size_t start;
+    char **matches;
+
+    ed->buf[ed->len] = '\0';
+    int total = complete_line(ed->state, ed->buf, ed->pos, &start, &matches);
+    if (total == 0 || matches == NULL || matches[0] == NULL) {
+        free_string_array(matches);
+        term_write("\a", 1);
+        return;
+    }
+
+    /* Longest prefix the candidates share */
+    size_t common = strlen(matches[0]);
+    for (int i = 1; matches[i] != NULL; i++) {
+        size_t j = 0;
+        while (j < common && matches[i][j] == matches[0][j]) j++;
+        common = j;
+    }
+
+    size_t word_len = ed->pos - start;
+    if (common > word_len) {
+        insert(ed, matches[0] + word_len, common - word_len);
+        ed->last_tab = 0;
+    } else if (total > 1 && ed->last_tab) {
+        list_candidates(matches, total);
+        ed->last_tab = 0;
+    } else if (total > 1) {
+        term_write("\a", 1);
+        ed->last_tab = 1;
+    }
+
+    /* A unique command or file is finished: the next word can follow */
+    if (total == 1 && common > 0 && matches[0][common - 1] != '/' &&
+        (ed->pos == ed->len || ed->buf[ed->pos] != ' ')) {
+        insert(ed, " ", 1);
+    }
+    free_string_array(matches);
+}
+
+/* Replace the line with text */
+static void set_line(editor_t *ed, const char *text, size_t len)
+{
+    if (len >= sizeof(ed->buf)) len = sizeof(ed->buf) - 1;
+    memcpy(ed->buf, text, len);
+    ed->len = ed->pos = len;
+}
+
+/* Step to an older (-1) or newer (+1) history entry; past the newest
+ * is the draft. History is counted only once it is browsed */
+static void browse(editor_t *ed, int step)
+{
+    int count = history_count(ed->state);
+    int shown = ed->hist_index < 0 ? count : ed->hist_index;
+    int i = shown + step;
+    size_t len;
+
+    if (i < 0 || i > count) return;
+    if (shown == count) {
+        free(ed->draft);
+        ed->draft = strndup(ed->buf, ed->len);
+    }
+    ed->hist_index = i == count ? -1 : i;
+
+    if (i == count) {
+        set_line(ed, ed->draft ? ed->draft : "", ed->draft ? strlen(ed->draft) : 0);
+    } else {
+        const char *text = history_get(ed->state, i, &len);
+        set_line(ed, text, len);
+    }
+}
+
+/* Ctrl-R: incremental reverse search. Typing narrows the query, Ctrl-R
+ * again finds an older match and Ctrl-G gives up; any other key takes
+ * the match into the line and then acts as usual (Enter runs it).
+ * Returns that key, or 0 if there is none */
+static int search(editor_t *ed)
+{
+    char query[256];
+    size_t qlen = 0;
+    int count = history_count(ed->state);
+    int match = -1;
+    int failed = 0;
+
+    query[0] = '\0';
+    for (;;) {
+        buffer_t out;
+        size_t len = 0;
+        const char *text = match >= 0 ? history_get(ed->state, match, &len) : "";
+
+        buf_init(&out);
+        buf_append(&out, "\r", 1);
+        if (failed) buf_append(&out, "failing ", 8);
+        buf_append(&out, "(reverse-i-search)`", 19);
+        buf_append(&out, query, qlen);
+        buf_append(&out, "': ", 3);
+        buf_append(&out, text, len);
+        buf_append(&out, "\x1b[K", 3);
+        term_write(out.data, out.len);
+        buf_free(&out);
+
+        int c = read_key();
+        if (c == CTRL('R')) {
+            int older = history_search(ed->state, query, match >= 0 ? match : count);
+            failed = older < 0;
+            if (older >= 0) match = older;
+            continue;
+        }
+        if (c == 127 || c == CTRL('H')) {
+            if (qlen > 0) query[--qlen] = '\0';
+        } else if (c >= ' ' && qlen + 1 < sizeof(query)) {
+            query[qlen++] = (char)c;
+            query[qlen] = '\0';
+        } else {
+            if (c == CTRL('G') || c < 0) {
+                return c < 0 ? c : 0;
+            }
+            if (match >= 0) {
+                set_line(ed, text, len);
+                ed->hist_index = match;
+            }
+            return c;
+        }
+
+        /* The query changed: look again from the newest entry */
+        match = qlen > 0 ? history_search(ed->state, query, count) : -1;
+        failed = qlen > 0 && match < 0;
+    }
+}
+
+/* Read a line with editing; returns NULL at end of input */
+static char *edit(editor_t *ed)
+{
+    for (;;) {
+        int c = read_key();
+        int tab = 0;
+
+        if (c == CTRL('R')) {
+            c = search(ed);
+            if (c == 0) {
+                refresh(ed);
+                continue;
+            }
+        }
+
+        if (c < 0) {
+            return ed->len > 0 ? strndup(ed->buf, ed->len) : NULL;
+        }
+
+        switch (c) {
+        case '\r':
+        case '\n':
+            term_write("\r\n", 2);
+            return strndup(ed->buf, ed->len);
+        case CTRL('C'):
+            term_write("^C\r\n", 4);
+            ed->len = ed->pos = 0;
+            break;
+        case CTRL('D'):
+            if (ed->len == 0) {
+                return NULL;
+            }
+            if (ed->pos < ed->len) delete_range(ed, ed->pos, ed->pos + 1);
+            break;
+        case '\t':
+            complete(ed);
+            tab = ed->last_tab;
+            break;
+        case 127:
+        case CTRL('H'):
+            if (ed->pos > 0) delete_range(ed, ed->pos - 1, ed->pos);
+            break;
+        case CTRL('A'):
+            ed->pos = 0;
+            break;
+        case CTRL('E'):
+            ed->pos = ed->len;
+            break;
+        case CTRL('B'):
+            if (ed->pos > 0) ed->pos--;
+            break;
+        case CTRL('F'):
+            if (ed->pos < ed->len) ed->pos++;
+            break;
+        case CTRL('U'):
+            delete_range(ed, 0, ed->pos);
+            break;
+        case CTRL('K'):
+            ed->len = ed->pos;
+            break;
+        case CTRL('W'): {
+            size_t from = ed->pos;
+            while (from > 0 && ed->buf[from - 1] == ' ') from--;
+            while (from > 0 && ed->buf[from - 1] != ' ') from--;
+            delete_range(ed, from, ed->pos);
+            break;
+        }
+        case CTRL('P'):
+            browse(ed, -1);
+            break;
+        case CTRL('N'):
+            browse(ed, 1);
+            break;
+        case CTRL('L'):
+            term_write("\x1b[H\x1b[2J", 7);
+            break;
+        case 27: {
+            /* ESC [ X or ESC [ n ~ (also ESC O X) */
+            int a = read_key();
+            int b = read_key();
+            if (a != '[' && a != 'O') break;
+            if (b >= '0' && b <= '9') {
+                if (read_key() != '~') break;
+                if (b == '3' && ed->pos < ed->len) {
+                    delete_range(ed, ed->pos, ed->pos + 1);
+                } else if (b == '1' || b == '7') {
+                    ed->pos = 0;
+                } else if (b == '4' || b == '8') {
+                    ed->pos = ed->len;
+                }
+            } else if (b == 'A') {
+                browse(ed, -1);
+            } else if (b == 'B') {
+                browse(ed, 1);
+            } else if (b == 'D' && ed->pos > 0) {
+                ed->pos--;
+            } else if (b == 'C' && ed->pos < ed->len) {
+                ed->pos++;
+            } else if (b == 'H') {
+                ed->pos = 0;
+            } else if (b == 'F') {
+                ed->pos = ed->len;
+            }
+            break;
+        }
+        default:
+            if (c >= ' ') {
+                char ch = (char)c;
+                insert(ed, &ch, 1);
+            }
+            break;
+        }
+
+        ed->last_tab = tab;
+        refresh(ed);
+    }
+}
+
+/* Prompt for and read one line from the terminal */
+char *edit_line(shell_state_t *state, const char *prompt)
+{
+    struct termios saved, raw;
+    editor_t ed;
+
+    if (tcgetattr(STDIN_FILENO, &saved) != 0) return NULL;
+    raw = saved;
+    raw.c_iflag &= ~(ICRNL | IXON);
+    raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+
+    memset(&ed, 0, sizeof(ed));
+    ed.state = state;
+    ed.prompt = prompt;
+    ed.hist_index = -1;
+    fflush(stdout);
+    refresh(&ed);
+
+    char *line = edit(&ed);
+
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &saved);
+    free(ed.draft);
+    if (line != NULL && line[strspn(line, " \t")] != '\0') {
+        history_add(state, line);
+    }
+    return line;
+}
\ No newline at end of file
@@ -0,0 +1,392 @@
+/* src/loop.c - while loops
+ *
+ *     while COMMANDS; do COMMANDS; done [redirections]
+ *
+ * A loop may span lines; the reader joins them (join_loop_lines()) and
+ * run_loop() splits the text into statements once. A statement without
+ * expansions is parsed once and that parse reused on every iteration;
+ * the others are parsed again each time they run, as a line read anew
+ * would be, so they see the variables that earlier statements set.
+ * Redirections after done apply to the whole loop, which is how read
+ * gets its input: done < file, or done < <(command).
+ */
+
+#include "../include/shell.h"
+
+/* One command line of a loop, or a nested loop */
+typedef struct loop_stmt_s {
+    char *text;                 /* Command line, NULL for a loop */
+    command_t *cmd;             /* Parse shared by every run, if static */
+    struct loop_s *loop;
+    struct loop_stmt_s *next;
+} loop_stmt_t;
+
+typedef struct loop_s {
+    loop_stmt_t *cond;          /* while ... */
+    loop_stmt_t *body;          /* do ... */
+    char *tail;                 /* "done [redirections]" */
+} loop_t;
+
+/* Position in the loop text: the current statement is seg[0..len) */
+typedef struct cursor_s {
+    const char *next;
+    const char *seg;
+    size_t len;
+} cursor_t;
+
+/* Load the next statement: text up to an unquoted ';' or newline, with
+ * comments dropped. Returns 0 at the end of the text */
+static int cursor_advance(cursor_t *c)
+{
+    const char *p = c->next;
+
+    for (;;) {
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == ';') p++;
+        if (*p == '\0') {
+            c->next = p;
+            c->seg = p;
+            c->len = 0;
+            return 0;
+        }
+
+        const char *start = p;
+        const char *end = NULL;
+        while (*p != '\0' && *p != '\n' && *p != ';') {
+            if (*p == '\'' || *p == '"') {
+                const char *close = strchr(p + 1, *p);
+                p = close ? close + 1 : p + strlen(p);
+            } else if ((p[0] == '$' && p[1] == '(') || p[0] == '`' ||
+                ((p[0] == '<' || p[0] == '>') && p[1] == '(')) {
+                char *close = skip_substitution((char *)p);
+                p = close ? close : p + strlen(p);
+            } else if (*p == '#') {
+                end = p;
+                p += strcspn(p, "\n");
+            } else {
+                p++;
+            }
+        }
+        if (end == NULL) end = p;
+        while (end > start && (end[-1] == ' ' || end[-1] == '\t')) end--;
+
+        c->next = p;
+        if (end > start) {
+            c->seg = start;
+            c->len = end - start;
+            return 1;
+        }
+    }
+}
+
+/* Does the current statement start with keyword kw? */
+static int at_keyword(cursor_t *c, const char *kw)
+{
+    size_t n = strlen(kw);
+
+    if (c->len < n || strncmp(c->seg, kw, n) != 0) return 0;
+    if (c->len == n) return 1;
+    char after = c->seg[n];
+    return after == ' ' || after == '\t' || after == '<' || after == '>';
+}
+
+/* Drop keyword kw from the front of the current statement */
+static void eat_keyword(cursor_t *c, const char *kw)
+{
+    size_t n = strlen(kw);
+
+    c->seg += n;
+    c->len -= n;
+    while (c->len > 0 && (*c->seg == ' ' || *c->seg == '\t')) {
+        c->seg++;
+        c->len--;
+    }
+}
+
+/* Net number of loops a line opens (while minus done) */
+int loop_depth(const char *text)
+{
+    cursor_t c = { text, text, 0 };
+    int depth = 0;
+
+    while (cursor_advance(&c)) {
+        for (;;) {
+            if (at_keyword(&c, "while")) {
+                depth++;
+                eat_keyword(&c, "while");
+            } else if (at_keyword(&c, "do")) {
+                eat_keyword(&c, "do");
+            } else {
+                break;
+            }
+        }
+        if (at_keyword(&c, "done")) depth--;
+    }
+    return depth;
+}
+
+/* Does the text start with a loop? */
+int starts_loop(const char *text)
+{
+    cursor_t c = { text, text, 0 };
+    return cursor_advance(&c) && at_keyword(&c, "while");
+}
+
+/* Read the rest of a loop the first line opens, joined by newlines */
+char *join_loop_lines(char *first, char *(*read_more)(void *), void *ctx)
+{
+    buffer_t text;
+    int depth = loop_depth(first);
+
+    buf_init(&text);
+    buf_append(&text, first, strlen(first));
+    free(first);
+
+    while (depth > 0) {
+        char *line = read_more(ctx);
+        if (line == NULL) break;
+        depth += loop_depth(line);
+        buf_append(&text, "\n", 1);
+        buf_append(&text, line, strlen(line));
+        free(line);
+    }
+    return buf_release(&text);
+}
+
+static void free_stmts(loop_stmt_t *s);
+
+static void free_loop(loop_t *loop)
+{
+    if (loop == NULL) return;
+    free_stmts(loop->cond);
+    free_stmts(loop->body);
+    free(loop->tail);
+    free(loop);
+}
+
+static void free_stmts(loop_stmt_t *s)
+{
+    while (s != NULL) {
+        loop_stmt_t *next = s->next;
+        free(s->text);
+        free_command(s->cmd);
+        free_loop(s->loop);
+        free(s);
+        s = next;
+    }
+}
+
+/* Parse a statement ahead of time if nothing in it depends on state */
+static command_t *parse_static(const char *text)
+{
+    if (!parse_is_static(text)) return NULL;
+
+    set_errors_quiet(1);
+    command_t *cmd = parse_command((char *)text, NULL);
+    set_errors_quiet(0);
+
+    /* Process substitutions rewrite their command when started */
+    for (command_t *c = cmd; c != NULL; c = c->next) {
+        if (c->procsubs != NULL) {
+            free_command(cmd);
+            return NULL;
+        }
+    }
+    return cmd;
+}
+
+static loop_t *build_loop(cursor_t *c);
+
+/* Statements up to keyword end (or the end of the text if NULL); the
+ * cursor is left on the keyword. Sets *ok to 0 on a syntax error */
+static loop_stmt_t *build_list(cursor_t *c, const char *end, int *ok)
+{
+    loop_stmt_t *head = NULL;
+    loop_stmt_t **tail = &head;
+
+    for (;;) {
+        if (c->len == 0 && !cursor_advance(c)) {
+            if (end != NULL) {
+                fprintf(stderr, "while: missing '%s'\n", end);
+                *ok = 0;
+            }
+            return head;
+        }
+        if (end != NULL && at_keyword(c, end)) {
+            return head;
+        }
+        if (at_keyword(c, "do") || at_keyword(c, "done")) {
+            fprintf(stderr, "while: unexpected '%.*s'\n", (int)c->len, c->seg);
+            *ok = 0;
+            return head;
+        }
+
+        loop_stmt_t *s = calloc(1, sizeof(loop_stmt_t));
+        if (s == NULL) {
+            *ok = 0;
+            return head;
+        }
+        *tail = s;
+        tail = &s->next;
+
+        if (at_keyword(c, "while")) {
+            s->loop = build_loop(c);
+            if (s->loop == NULL) {
+                *ok = 0;
+                return head;
+            }
+            continue;
+        }
+
+        s->text = malloc(c->len + 1);
+        if (s->text == NULL) {
+            *ok = 0;
+            return head;
+        }
+        memcpy(s->text, c->seg, c->len);
+        s->text[c->len] = '\0';
+        c->len = 0;
+
+        int count;
+        char **delims = scan_heredoc_delimiters(s->text, &count);
+        free_string_array(delims);
+        if (count > 0) {
+            fprintf(stderr, "while: here-documents are not supported in loops\n");
+            *ok = 0;
+            return head;
+        }
+        s->cmd = parse_static(s->text);
+    }
+}
+
+/* A loop, with the cursor on its "while" */
+static loop_t *build_loop(cursor_t *c)
+{
+    int ok = 1;
+    loop_t *loop = calloc(1, sizeof(loop_t));
+    if (loop == NULL) return NULL;
+
+    eat_keyword(c, "while");
+    loop->cond = build_list(c, "do", &ok);
+    if (ok && loop->cond == NULL) {
+        fprintf(stderr, "while: missing condition\n");
+        ok = 0;
+    }
+    if (ok) {
+        eat_keyword(c, "do");
+        loop->body = build_list(c, "done", &ok);
+        if (ok && loop->body == NULL) {
+            fprintf(stderr, "while: missing body\n");
+            ok = 0;
+        }
+    }
+    if (ok) {
+        loop->tail = malloc(c->len + 1);
+        if (loop->tail != NULL) {
+            memcpy(loop->tail, c->seg, c->len);
+            loop->tail[c->len] = '\0';
+        }
+        c->len = 0;
+        ok = loop->tail != NULL;
+    }
+
+    if (!ok) {
+        free_loop(loop);
+        return NULL;
+    }
+    return loop;
+}
+
+static int run_while(loop_t *loop, shell_state_t *state);
+
+/* Run statements in order; the status is the last one's */
+static int run_stmts(loop_stmt_t *s, shell_state_t *state)
+{
+    int status = 0;
+
+    for (; s != NULL && !state->exit_requested; s = s->next) {
+        if (s->loop != NULL) {
+            status = run_while(s->loop, state);
+        } else if (s->cmd != NULL) {
+            status = execute_command(s->cmd, state);
+        } else {
+            command_t *cmd = parse_command(s->text, state);
+            if (cmd == NULL) {
+                state->last_exit_status = 1;
+                status = 1;
+                continue;
+            }
+            status = execute_command(cmd, state);
+            free_command(cmd);
+        }
+    }
+    return status;
+}
+
+/* Run a loop with its redirections applied around it */
+static int run_while(loop_t *loop, shell_state_t *state)
+{
+    redir_save_t save;
+    int status = 0;
+
+    /* "done < file" parses as a command named done */
+    command_t *tail = parse_command(loop->tail, state);
+    if (tail == NULL) {
+        state->last_exit_status = 1;
+        return 1;
+    }
+
+    if (tail->procsubs != NULL && start_procsubs(tail, state) != 0) {
+        wait_procsubs(tail, state);
+        free_command(tail);
+        state->last_exit_status = 1;
+        return 1;
+    }
+    fflush(state->out);
+    if (apply_redirections(tail->redirs, &save) != 0) {
+        restore_redirections(&save);
+        wait_procsubs(tail, state);
+        free_command(tail);
+        state->last_exit_status = 1;
+        return 1;
+    }
+
+    while (!state->exit_requested && run_stmts(loop->cond, state) == 0 &&
+        !state->exit_requested) {
+        status = run_stmts(loop->body, state);
+    }
+
+    fflush(state->out);
+    restore_redirections(&save);
+    if (tail->procsubs != NULL) {
+        wait_procsubs(tail, state);
+    }
+    free_command(tail);
+
+    if (!state->exit_requested) {
+        state->last_exit_status = status;
+    }
+    return status;
+}
+
+/* Run text holding one or more loops and other statements */
+int run_loop(const char *text, shell_state_t *state)
+{
+    cursor_t c = { text, text, 0 };
+    int ok = 1;
+
+    loop_stmt_t *stmts = build_list(&c, NULL, &ok);
+    if (!ok) {
+        free_stmts(stmts);
+        state->last_exit_status = 1;
+        return 1;
+    }
+
+    /* Control must come back for the next iteration */
+    int exec_tail = state->exec_tail;
+    state->exec_tail = 0;
+    int status = run_stmts(stmts, state);
+    state->exec_tail = exec_tail;
+
+    free_stmts(stmts);
+    return status;
+}
\ No newline at end of file
@@ -0,0 +1,129 @@
+/* src/metrics.c - Runtime counters and their Prometheus export
+ *
+ * The shell counts its own overhead in state->metrics: forks, external
+ * commands started, PATH candidates probed, time spent parsing, and
+ * commands by exit status. `stats` prints them. If $OSHELL_METRICS_FILE
+ * is set, they are also written there in the Prometheus text format,
+ * at most every $OSHELL_METRICS_INTERVAL seconds (default 10) between
+ * commands and once more on exit. The file is replaced by rename(), so
+ * a collector never sees it half written.
+ */
+
+#include "../include/shell.h"
+#include <malloc.h>
+#include <time.h>
+
+#define METRICS_DEFAULT_INTERVAL 10
+
+/* Monotonic clock in nanoseconds */
+long metrics_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* Account one parse that took ns */
+void metrics_add_parse(shell_state_t *state, long ns)
+{
+    state->metrics.parses++;
+    state->metrics.parse_ns += ns;
+}
+
+/* Account a finished foreground command */
+void metrics_add_status(shell_state_t *state, int status)
+{
+    state->metrics.exit_status[status & 0xff]++;
+}
+
+/* Bytes the allocator has handed out and not had back */
+static size_t heap_in_use(void)
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+/* Print the counters for the stats builtin */
+void metrics_print(shell_state_t *state, FILE *fp)
+{
+    shell_metrics_t *m = &state->metrics;
+
+    fprintf(fp, "processes: %ld forks, %ld commands started, %ld PATH probes, "
+        "%ld prescan hits\n", m->forks, m->execs, m->path_probes, m->prescan_hits);
+    fprintf(fp, "parsing: %ld lines in %.3f ms\n", m->parses, m->parse_ns / 1e6);
+    fprintf(fp, "heap: %zu bytes in use\n", heap_in_use());
+    fprintf(fp, "background jobs: %ld started, %ld reaped\n",
+        state->jobs_started, m->jobs_reaped);
+
+    fprintf(fp, "exit statuses:");
+    for (int i = 0; i < 256; i++) {
+        if (m->exit_status[i] > 0) fprintf(fp, " %d=%ld", i, m->exit_status[i]);
+    }
+    fprintf(fp, "\n");
+}
+
+static void counter(FILE *fp, const char *name, const char *help, double value)
+{
+    fprintf(fp, "# HELP oshell_%s %s\n# TYPE oshell_%s counter\noshell_%s %.15g\n",
+        name, help, name, name, value);
+}
+
+/* Write the counters to $OSHELL_METRICS_FILE */
+void metrics_write(shell_state_t *state)
+{
+    const char *path = getenv("OSHELL_METRICS_FILE");
+    shell_metrics_t *m = &state->metrics;
+    char tmp[MAX_PATH_LEN];
+
+    if (path == NULL || *path == '\0') return;
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+
+    FILE *fp = fopen(tmp, "we");
+    if (fp == NULL) return;
+
+    counter(fp, "forks_total", "Processes forked by the shell.", m->forks);
+    counter(fp, "commands_started_total", "External commands started.", m->execs);
+    counter(fp, "path_probes_total", "Candidate paths tried in the search path.",
+        m->path_probes);
+    counter(fp, "prescan_hits_total", "Command lookups answered by the prescan.",
+        m->prescan_hits);
+    counter(fp, "parses_total", "Command lines parsed.", m->parses);
+    counter(fp, "parse_seconds_total", "Time spent parsing.", m->parse_ns / 1e9);
+    counter(fp, "jobs_started_total", "Background jobs started.", state->jobs_started);
+    counter(fp, "jobs_reaped_total", "Background jobs reaped.", m->jobs_reaped);
+    counter(fp, "children_reaped_total", "Child processes reaped.",
+        state->children_reaped);
+
+    fprintf(fp, "# HELP oshell_heap_bytes Heap memory in use.\n"
+        "# TYPE oshell_heap_bytes gauge\noshell_heap_bytes %zu\n", heap_in_use());
+
+    fprintf(fp, "# HELP oshell_commands_total Foreground commands finished, "
+        "by exit status.\n# TYPE oshell_commands_total counter\n");
+    for (int i = 0; i < 256; i++) {
+        if (m->exit_status[i] > 0) {
+            fprintf(fp, "oshell_commands_total{status=\"%d\"} %ld\n", i, m->exit_status[i]);
+        }
+    }
+
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+    }
+}
+
+/* Write the metrics file if the interval has passed */
+void metrics_tick(shell_state_t *state)
+{
+    const char *path = getenv("OSHELL_METRICS_FILE");
+    if (path == NULL || *path == '\0') return;
+
+    const char *interval = getenv("OSHELL_METRICS_INTERVAL");
+    long seconds = interval ? atol(interval) : 0;
+    if (seconds <= 0) seconds = METRICS_DEFAULT_INTERVAL;
+
+    long now = metrics_now_ns();
+    if (state->metrics.written_ns == 0 ||
+        now - state->metrics.written_ns >= seconds * 1000000000L) {
+        metrics_write(state);
+        state->metrics.written_ns = now;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,322 @@
+/* src/outmux.c - Tagged, line-multiplexed output of background jobs
+ *
+ * With $OSHELL_TAG_OUTPUT set, a background job's stdout and stderr are
+ * pipes rather than the shell's own descriptors. A thread watches every
+ * such pipe with epoll and copies whole lines to the shell's stdout or
+ * stderr, each prefixed with "[job pid HH:MM:SS.mmm] ", so lines from
+ * concurrent jobs never interleave mid-line. Pipes and buffers are
+ * $OSHELL_TAG_BUFFER bytes (default 64K) and lines go out in batches
+ * through writev().
+ */
+
+#include "../include/shell.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+
+#define OUTMUX_DEFAULT_BUFFER (64 * 1024)
+#define OUTMUX_MIN_BUFFER 1024
+
+/* iovecs per writev (IOV_MAX is 1024 on Linux) */
+#define OUTMUX_IOV_BATCH 512
+
+#define OUTMUX_MAX_EVENTS 64
+
+/* One job's stdout or stderr */
+typedef struct outmux_stream_s {
+    int fd;                     /* Read end of the job's pipe */
+    int dest;                   /* Where its lines go */
+    int job_id;
+    pid_t pid;
+    char *buf;
+    size_t len;
+    size_t cap;
+} outmux_stream_t;
+
+struct outmux_s {
+    int epfd;
+    int wake;                   /* eventfd: stop requested */
+    int out_fd;                 /* Private copies of the shell's 1 and 2, */
+    int err_fd;                 /* immune to in-process redirections */
+    _Atomic int active;         /* Streams not yet at EOF */
+    _Atomic int stop;
+    pthread_t thread;
+    pid_t owner;                /* Forked copies of the shell have no thread */
+};
+
+/* Is tagged output requested? */
+int outmux_wanted(void)
+{
+    const char *value = getenv("OSHELL_TAG_OUTPUT");
+    return value != NULL && *value != '\0' && strcmp(value, "0") != 0;
+}
+
+/* Buffer (and pipe) size from $OSHELL_TAG_BUFFER */
+static size_t buffer_size(void)
+{
+    const char *value = getenv("OSHELL_TAG_BUFFER");
+    long size = value ? atol(value) : 0;
+
+    if (size <= 0) return OUTMUX_DEFAULT_BUFFER;
+    return size < OUTMUX_MIN_BUFFER ? OUTMUX_MIN_BUFFER : (size_t)size;
+}
+
+/* writev() everything, resuming after partial writes */
+static void writev_all(int fd, struct iovec *iov, int count)
+{
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+/* Write out the complete lines in the buffer; with force, also the
+ * trailing partial line (at EOF, or when one line fills the buffer) */
+static void stream_emit(outmux_stream_t *s, int force)
+{
+    static char newline[] = "\n";
+    struct iovec iov[OUTMUX_IOV_BATCH];
+    char prefix[64];
+    struct timespec now;
+    struct tm tm;
+    int count = 0;
+    size_t start = 0;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    localtime_r(&now.tv_sec, &tm);
+    int prefix_len = snprintf(prefix, sizeof(prefix), "[%d %d %02d:%02d:%02d.%03ld] ",
+        s->job_id, (int)s->pid, tm.tm_hour, tm.tm_min, tm.tm_sec,
+        now.tv_nsec / 1000000);
+
+    for (;;) {
+        char *nl = memchr(s->buf + start, '\n', s->len - start);
+        if (nl == NULL) break;
+
+        size_t end = nl - s->buf + 1;
+        if (count + 2 > OUTMUX_IOV_BATCH) {
+            writev_all(s->dest, iov, count);
+            count = 0;
+        }
+        iov[count++] = (struct iovec){ prefix, prefix_len };
+        iov[count++] = (struct iovec){ s->buf + start, end - start };
+        start = end;
+    }
+
+    if (force && start < s->len) {
+        if (count + 3 > OUTMUX_IOV_BATCH) {
+            writev_all(s->dest, iov, count);
+            count = 0;
+        }
+        iov[count++] = (struct iovec){ prefix, prefix_len };
+        iov[count++] = (struct iovec){ s->buf + start, s->len - start };
+        iov[count++] = (struct iovec){ newline, 1 };
+        start = s->len;
+    }
+
+    if (count > 0) {
+        writev_all(s->dest, iov, count);
+    }
+
+    /* Keep the unfinished line at the front */
+    memmove(s->buf, s->buf + start, s->len - start);
+    s->len -= start;
+}
+
+/* Read what the pipe holds; returns 0 at EOF */
+static int stream_read(outmux_stream_t *s)
+{
+    ssize_t n = read(s->fd, s->buf + s->len, s->cap - s->len);
+    if (n < 0) {
+        return errno == EINTR || errno == EAGAIN;
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    s->len += n;
+    stream_emit(s, s->len == s->cap);
+    return 1;
+}
+
+/* Flush and release a stream whose job closed it */
+static void stream_close(struct outmux_s *mux, outmux_stream_t *s)
+{
+    stream_emit(s, 1);
+    epoll_ctl(mux->epfd, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);
+    free(s->buf);
+    free(s);
+    atomic_fetch_sub(&mux->active, 1);
+}
+
+/* Mux thread: forward lines until stopped and every stream is done */
+static void *outmux_main(void *arg)
+{
+    struct outmux_s *mux = arg;
+    struct epoll_event events[OUTMUX_MAX_EVENTS];
+
+    while (!atomic_load(&mux->stop) || atomic_load(&mux->active) > 0) {
+        int n = epoll_wait(mux->epfd, events, OUTMUX_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            outmux_stream_t *s = events[i].data.ptr;
+            if (s == NULL) {
+                uint64_t value;
+                if (read(mux->wake, &value, sizeof(value)) < 0) {
+                    /* Nothing to clear */
+                }
+                continue;
+            }
+            if (!stream_read(s)) {
+                stream_close(mux, s);
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Create the mux and its thread */
+static int outmux_start(shell_state_t *state)
+{
+    struct outmux_s *mux = calloc(1, sizeof(struct outmux_s));
+    if (mux == NULL) return -1;
+
+    mux->epfd = move_fd_high(epoll_create1(EPOLL_CLOEXEC));
+    mux->wake = move_fd_high(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    mux->out_fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    mux->err_fd = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 10);
+
+    struct epoll_event ev = { EPOLLIN, { .ptr = NULL } };
+    if (mux->epfd < 0 || mux->wake < 0 || mux->out_fd < 0 || mux->err_fd < 0 ||
+        epoll_ctl(mux->epfd, EPOLL_CTL_ADD, mux->wake, &ev) != 0 ||
+        pthread_create(&mux->thread, NULL, outmux_main, mux) != 0) {
+        if (mux->epfd >= 0) close(mux->epfd);
+        if (mux->wake >= 0) close(mux->wake);
+        if (mux->out_fd >= 0) close(mux->out_fd);
+        if (mux->err_fd >= 0) close(mux->err_fd);
+        free(mux);
+        return -1;
+    }
+
+    mux->owner = getpid();
+    state->outmux = mux;
+    return 0;
+}
+
+/* Route cmd's stdout and stderr into fresh pipes, ahead of its own
+ * redirections; outmux_attach() must follow the spawn */
+int outmux_tap(shell_state_t *state, command_t *cmd, output_tap_t *tap)
+{
+    if (state->outmux == NULL && outmux_start(state) != 0) {
+        return -1;
+    }
+    if (state->outmux->owner != getpid()) {
+        return -1;
+    }
+
+    int size = (int)buffer_size();
+    for (int i = 0; i < 2; i++) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0) {
+            if (i == 1) {
+                close(tap->read_fds[0]);
+                close(tap->redirs[0].target_fd);
+            }
+            return -1;
+        }
+        fcntl(fds[0], F_SETPIPE_SZ, size);
+
+        tap->read_fds[i] = move_fd_high(fds[0]);
+        memset(&tap->redirs[i], 0, sizeof(redirect_t));
+        tap->redirs[i].type = REDIR_DUP;
+        tap->redirs[i].fd = STDOUT_FILENO + i;
+        tap->redirs[i].target_fd = fds[1];
+    }
+
+    tap->redirs[0].next = &tap->redirs[1];
+    tap->redirs[1].next = cmd->redirs;
+    cmd->redirs = &tap->redirs[0];
+    return 0;
+}
+
+/* Undo outmux_tap() once the job has started (pid > 0) and hand the
+ * read ends to the mux thread; if the spawn failed, just close them */
+void outmux_attach(shell_state_t *state, command_t *cmd, output_tap_t *tap,
+    int job_id, pid_t pid)
+{
+    struct outmux_s *mux = state->outmux;
+
+    cmd->redirs = tap->redirs[1].next;
+
+    for (int i = 0; i < 2; i++) {
+        close(tap->redirs[i].target_fd);
+
+        outmux_stream_t *s = NULL;
+        if (pid > 0) {
+            s = calloc(1, sizeof(outmux_stream_t));
+        }
+        if (s != NULL) {
+            s->cap = buffer_size();
+            s->buf = malloc(s->cap);
+        }
+        if (s == NULL || s->buf == NULL) {
+            if (s != NULL) free(s);
+            close(tap->read_fds[i]);
+            continue;
+        }
+
+        s->fd = tap->read_fds[i];
+        s->dest = i == 0 ? mux->out_fd : mux->err_fd;
+        s->job_id = job_id;
+        s->pid = pid;
+
+        atomic_fetch_add(&mux->active, 1);
+        struct epoll_event ev = { EPOLLIN, { .ptr = s } };
+        if (epoll_ctl(mux->epfd, EPOLL_CTL_ADD, s->fd, &ev) != 0) {
+            atomic_fetch_sub(&mux->active, 1);
+            close(s->fd);
+            free(s->buf);
+            free(s);
+        }
+    }
+}
+
+/* Wait for every tapped job to close its output, then stop the thread */
+void outmux_stop(shell_state_t *state)
+{
+    struct outmux_s *mux = state->outmux;
+    if (mux == NULL) return;
+
+    uint64_t one = 1;
+    atomic_store(&mux->stop, 1);
+    if (write(mux->wake, &one, sizeof(one)) < 0) {
+        /* The thread still sees stop on its next wakeup */
+    }
+    pthread_join(mux->thread, NULL);
+
+    close(mux->epfd);
+    close(mux->wake);
+    close(mux->out_fd);
+    close(mux->err_fd);
+    free(mux);
+    state->outmux = NULL;
+}
\ No newline at end of file
@@ -4,7 +4,8 @@
 
 static bool is_operator_char(char c)
 {
-    return (c == ';' || c == '&' || c == '|' || c == '>' || c == '#');
+    return (c == ';' || c == '&' || c == '|' || c == '>' || c == '<' ||
+        c == '#');
 }
 
 static char *skip_whitespace(char *str)
@@ -15,6 +16,22 @@ static char *skip_whitespace(char *str)
     return str;
 }
 
+/* Find the end of an unquoted word, keeping $(...) and `...` whole */
+static char *scan_word(char *pos)
+{
+    while (*pos && !isspace((unsigned char)*pos) && !is_operator_char(*pos)) {
+        if ((pos[0] == '$' && pos[1] == '(') || pos[0] == '`') {
+            char *end = skip_substitution(pos);
+            if (end != NULL) {
+                pos = end;
+                continue;
+            }
+        }
+        pos++;
+    }
+    return pos;
+}
+
 /* Get operator type from string */
 static operator_t get_operator(char *str)
 {
@@ -22,10 +39,205 @@ static operator_t get_operator(char *str)
     if (str[0] == '&' && str[1] == '&') return OP_AND;
     if (str[0] == '|' && str[1] == '|') return OP_OR;
     if (str[0] == '&') return OP_BACKGROUND;
-    if (str[0] == '>') return OP_REDIRECT;
+    if (str[0] == '>' || str[0] == '<') return OP_REDIRECT;
     return OP_NONE;
 }
 
+/* Read one (possibly quoted) word for a redirection target */
+static char *read_word(char **input_ptr, shell_state_t *state, bool expand,
+    bool *quoted)
+{
+    char *pos = skip_whitespace(*input_ptr);
+    char *start;
+    size_t len;
+    bool was_quoted = false;
+    bool double_quoted = false;
+    
+    if (*pos == '"' || *pos == '\'') {
+        char quote = *pos++;
+        start = pos;
+        while (*pos && *pos != quote) {
+            pos++;
+        }
+        if (!*pos) return NULL;
+        len = pos - start;
+        pos++; /* Skip closing quote */
+        was_quoted = true;
+        double_quoted = (quote == '"');
+    } else {
+        start = pos;
+        pos = scan_word(pos);
+        len = pos - start;
+        if (len == 0) return NULL;
+    }
+    
+    char *word = malloc(len + 1);
+    if (!word) return NULL;
+    memcpy(word, start, len);
+    word[len] = '\0';
+    
+    if (expand && (!was_quoted || double_quoted)) {
+        char *expanded = expand_variables(word, state);
+        if (expanded) {
+            free(word);
+            word = expanded;
+        }
+    }
+    
+    if (quoted) *quoted = was_quoted;
+    *input_ptr = pos;
+    return word;
+}
+
+/* Parse <(cmd) or >(cmd) at pos and attach it to cmd */
+static procsub_t *parse_procsub(char **input_ptr, command_t *cmd)
+{
+    char *pos = *input_ptr;
+    char *end = skip_substitution(pos);
+    if (!end) return NULL;
+    
+    procsub_t *ps = calloc(1, sizeof(procsub_t));
+    if (!ps) return NULL;
+    
+    size_t len = (end - pos) - 3;
+    ps->text = malloc(len + 1);
+    if (!ps->text) {
+        free(ps);
+        return NULL;
+    }
+    memcpy(ps->text, pos + 2, len);
+    ps->text[len] = '\0';
+    ps->output = (pos[0] == '>');
+    ps->arg_index = -1;
+    ps->fd = -1;
+    
+    /* Keep source order */
+    procsub_t **tail = &cmd->procsubs;
+    while (*tail) {
+        tail = &(*tail)->next;
+    }
+    *tail = ps;
+    
+    *input_ptr = end;
+    return ps;
+}
+
+/* Parse a redirection at the start of a word. Returns 1 if one was
+ * consumed, 0 if the word is not a redirection and -1 if malformed */
+static int parse_redirection(char **input_ptr, command_t *cmd, shell_state_t *state)
+{
+    char *pos = *input_ptr;
+    int fd = -1;
+    redir_type_t type;
+    
+    /* Optional descriptor number, e.g. 2>file */
+    if (isdigit((unsigned char)*pos)) {
+        char *digits_end = pos;
+        while (isdigit((unsigned char)*digits_end)) {
+            digits_end++;
+        }
+        if (*digits_end != '<' && *digits_end != '>') return 0;
+        fd = atoi(pos);
+        pos = digits_end;
+    }
+    
+    if (pos[0] == '&' && pos[1] == '>' && fd < 0) {
+        type = REDIR_BOTH;
+        fd = STDOUT_FILENO;
+        pos += 2;
+    } else if (pos[0] == '>') {
+        if (pos[1] == '>') {
+            type = REDIR_APPEND;
+            pos += 2;
+        } else if (pos[1] == '&') {
+            type = REDIR_DUP;
+            pos += 2;
+        } else {
+            type = REDIR_OUT;
+            pos++;
+        }
+        if (fd < 0) fd = STDOUT_FILENO;
+    } else if (pos[0] == '<') {
+        if (pos[1] == '<' && pos[2] == '<') {
+            type = REDIR_HERESTRING;
+            pos += 3;
+        } else if (pos[1] == '<') {
+            type = REDIR_HEREDOC;
+            pos += 2;
+        } else if (pos[1] == '&') {
+            type = REDIR_DUP;
+            pos += 2;
+        } else {
+            type = REDIR_IN;
+            pos++;
+        }
+        if (fd < 0) fd = STDIN_FILENO;
+    } else {
+        return 0;
+    }
+    
+    redirect_t *redir = calloc(1, sizeof(redirect_t));
+    if (!redir) return -1;
+    redir->type = type;
+    redir->fd = fd;
+    
+    /* Target may itself be a process substitution: > >(cmd) */
+    bool quoted = false;
+    pos = skip_whitespace(pos);
+    if ((type == REDIR_IN || type == REDIR_OUT || type == REDIR_APPEND) &&
+        (pos[0] == '<' || pos[0] == '>') && pos[1] == '(') {
+        procsub_t *ps = parse_procsub(&pos, cmd);
+        if (!ps) {
+            free(redir);
+            return -1;
+        }
+        ps->redir = redir;
+        redir->target = my_strdup("");
+    } else {
+        /* Here-document delimiters are taken literally */
+        redir->target = read_word(&pos, state, type != REDIR_HEREDOC, &quoted);
+    }
+    if (!redir->target) {
+        free(redir);
+        return -1;
+    }
+    
+    if (type == REDIR_DUP && strcmp(redir->target, "-") == 0) {
+        redir->target_fd = -1;      /* N>&- closes N */
+    } else if (type == REDIR_DUP) {
+        char *end;
+        long target_fd = strtol(redir->target, &end, 10);
+        if (end == redir->target || *end != '\0' || target_fd < 0) {
+            free_redirections(redir);
+            return -1;
+        }
+        redir->target_fd = (int)target_fd;
+    } else if (type == REDIR_HERESTRING) {
+        size_t len = strlen(redir->target);
+        redir->body = malloc(len + 2);
+        if (!redir->body) {
+            free_redirections(redir);
+            return -1;
+        }
+        memcpy(redir->body, redir->target, len);
+        redir->body[len] = '\n';
+        redir->body[len + 1] = '\0';
+    } else if (type == REDIR_HEREDOC) {
+        /* Body is read after the line by collect_heredocs() */
+        redir->quoted = quoted;
+    }
+    
+    /* Keep source order */
+    redirect_t **tail = &cmd->redirs;
+    while (*tail) {
+        tail = &(*tail)->next;
+    }
+    *tail = redir;
+    
+    *input_ptr = pos;
+    return 1;
+}
+
 static command_t *parse_single_command(char **input_ptr, shell_state_t *state)
 {
     char *pos = *input_ptr;
@@ -36,7 +248,7 @@ static command_t *parse_single_command(char **input_ptr, shell_state_t *state)
     }
     
     memset(cmd, 0, sizeof(command_t));
-    cmd->args = malloc(MAX_ARGS * sizeof(char *));
+    cmd->args = calloc(MAX_ARGS, sizeof(char *));
     if (!cmd->args) {
         free(cmd);
         print_error();
@@ -47,49 +259,44 @@ static command_t *parse_single_command(char **input_ptr, shell_state_t *state)
     bool in_quotes = false;
     char quote_char = 0;
     bool in_double_quotes = false;
+    bool deferred = false;      /* After -- of a BUILTIN_DEFER_ARGS builtin */
     
     while (*pos && *pos != '#') {
         pos = skip_whitespace(pos);
         if (!*pos || *pos == '#') break;
         
-        /* Check for operators that end or modify this command */
-        operator_t op = get_operator(pos);
-        
-        if (op == OP_REDIRECT) {
-            /* Handle output redirection */
-            pos++; /* Skip '>' */
-            pos = skip_whitespace(pos);
-            
+        /* Process substitution argument: <(cmd) or >(cmd) */
+        if ((pos[0] == '<' || pos[0] == '>') && pos[1] == '(') {
             char *start = pos;
-            while (*pos && !isspace((unsigned char)*pos) && !is_operator_char(*pos)) {
-                pos++;
-            }
-            
-            if (pos > start) {
-                size_t len = pos - start;
-                cmd->output_file = malloc(len + 1);
-                if (!cmd->output_file) {
-                    print_error();
-                    free_command(cmd);
-                    return NULL;
-                }
-                strncpy(cmd->output_file, start, len);
-                cmd->output_file[len] = '\0';
-                
-                /* Expand variables in output filename */
-                char *expanded_file = expand_variables(cmd->output_file, state);
-                if (expanded_file) {
-                    free(cmd->output_file);
-                    cmd->output_file = expanded_file;
-                }
-            } else {
+            procsub_t *ps = parse_procsub(&pos, cmd);
+            size_t len = pos - start;
+            if (!ps || arg_count >= MAX_ARGS - 1 ||
+                !(cmd->args[arg_count] = malloc(len + 1))) {
                 print_error();
                 free_command(cmd);
                 return NULL;
             }
+            memcpy(cmd->args[arg_count], start, len);
+            cmd->args[arg_count][len] = '\0';
+            ps->arg_index = arg_count++;
             continue;
         }
-        else if (op == OP_BACKGROUND) {
+        
+        /* Redirections modify this command */
+        int redir = parse_redirection(&pos, cmd, state);
+        if (redir < 0) {
+            print_error();
+            free_command(cmd);
+            return NULL;
+        }
+        if (redir > 0) {
+            continue;
+        }
+        
+        /* Check for operators that end this command */
+        operator_t op = get_operator(pos);
+        
+        if (op == OP_BACKGROUND) {
             /* Check if it's truly a background operator (not part of &&) */
             char next_char = *(pos + 1);
             if (isspace((unsigned char)next_char) || !next_char || is_operator_char(next_char)) {
@@ -117,6 +324,14 @@ static command_t *parse_single_command(char **input_ptr, shell_state_t *state)
         if (in_quotes) {
             /* Parse quoted string */
             while (*pos && *pos != quote_char) {
+                if (in_double_quotes &&
+                    ((pos[0] == '$' && pos[1] == '(') || pos[0] == '`')) {
+                    char *end = skip_substitution(pos);
+                    if (end != NULL) {
+                        pos = end;
+                        continue;
+                    }
+                }
                 pos++;
             }
             
@@ -138,7 +353,7 @@ static command_t *parse_single_command(char **input_ptr, shell_state_t *state)
                 cmd->args[arg_count][len] = '\0';
                 
                 /* Expand variables only in double quotes */
-                if (in_double_quotes) {
+                if (in_double_quotes && !deferred) {
                     char *expanded = expand_variables(cmd->args[arg_count], state);
                     if (expanded) {
                         free(cmd->args[arg_count]);
@@ -146,6 +361,19 @@ static command_t *parse_single_command(char **input_ptr, shell_state_t *state)
                     }
                 }
                 
+                /* The builtin must not expand single-quoted deferred words */
+                if (deferred && !in_double_quotes) {
+                    if (!cmd->literal) {
+                        cmd->literal = calloc(MAX_ARGS, 1);
+                    }
+                    if (!cmd->literal) {
+                        print_error();
+                        free_command(cmd);
+                        return NULL;
+                    }
+                    cmd->literal[arg_count] = 1;
+                }
+                
                 arg_count++;
                 pos++; /* Skip closing quote */
                 in_quotes = false;
@@ -158,9 +386,11 @@ static command_t *parse_single_command(char **input_ptr, shell_state_t *state)
                 return NULL;
             }
         } else {
-            /* Parse regular argument */
-            while (*pos && !isspace((unsigned char)*pos) && !is_operator_char(*pos)) {
-                pos++;
+            /* Parse regular argument; a stray operator character that
+             * starts no operator is taken literally instead of looping */
+            pos = scan_word(pos);
+            if (pos == start) {
+                pos = scan_word(pos + 1);
             }
             
             if (pos > start) {
@@ -181,13 +411,20 @@ static command_t *parse_single_command(char **input_ptr, shell_state_t *state)
                 cmd->args[arg_count][len] = '\0';
                 
                 /* Expand variables in the argument */
-                char *expanded = expand_variables(cmd->args[arg_count], state);
+                char *expanded = deferred ? NULL :
+                    expand_variables(cmd->args[arg_count], state);
                 if (expanded) {
                     free(cmd->args[arg_count]);
                     cmd->args[arg_count] = expanded;
                 }
                 
                 arg_count++;
+                
+                /* Some builtins expand the words after -- themselves */
+                if (!deferred && strcmp(cmd->args[arg_count - 1], "--") == 0) {
+                    int flags = builtin_flags(cmd->args[0]);
+                    deferred = flags >= 0 && (flags & BUILTIN_DEFER_ARGS);
+                }
             }
         }
     }
@@ -196,7 +433,7 @@ static command_t *parse_single_command(char **input_ptr, shell_state_t *state)
     *input_ptr = pos;
     
     /* Check if we parsed anything */
-    if (arg_count == 0 && !cmd->output_file && !cmd->background) {
+    if (arg_count == 0 && !cmd->redirs && !cmd->background) {
         free_command(cmd);
         return NULL;
     }
@@ -230,8 +467,72 @@ static operator_t find_next_operator(char *str, int *op_len)
     return op;
 }
 
+/* Does parsing this text depend on shell state? Only expansion
+ * consults it, so text without $ or backquotes parses the same
+ * whatever earlier lines changed, and never touches state */
+int parse_is_static(const char *text)
+{
+    return strchr(text, '$') == NULL && strchr(text, '`') == NULL;
+}
+
+/* Collect the delimiters of here-documents on a line, in order,
+ * without parsing it (for reading ahead of the parser) */
+char **scan_heredoc_delimiters(char *line, int *count)
+{
+    char **delims = NULL;
+    int n = 0;
+    char *pos = line;
+    
+    while (*pos && *pos != '#') {
+        if (*pos == '\'' || *pos == '"') {
+            char *close = strchr(pos + 1, *pos);
+            if (!close) break;
+            pos = close + 1;
+        } else if ((pos[0] == '$' && pos[1] == '(') || pos[0] == '`') {
+            char *end = skip_substitution(pos);
+            if (!end) break;
+            pos = end;
+        } else if (pos[0] == '<' && pos[1] == '<' && pos[2] != '<') {
+            pos = skip_whitespace(pos + 2);
+            char *start = pos;
+            size_t len;
+            if (*pos == '\'' || *pos == '"') {
+                char *close = strchr(pos + 1, *pos);
+                if (!close) break;
+                start = pos + 1;
+                len = close - start;
+                pos = close + 1;
+            } else {
+                pos = scan_word(pos);
+                len = pos - start;
+            }
+            if (len == 0) continue;
+            
+            char **grown = realloc(delims, (n + 2) * sizeof(char *));
+            char *word = malloc(len + 1);
+            if (!grown || !word) {
+                free(word);
+                delims = grown ? grown : delims;
+                break;
+            }
+            delims = grown;
+            memcpy(word, start, len);
+            word[len] = '\0';
+            delims[n++] = word;
+            delims[n] = NULL;
+        } else if (pos[0] == '<' && pos[1] == '<') {
+            pos += 3; /* Here-string */
+        } else {
+            pos++;
+        }
+    }
+    
+    *count = n;
+    return delims;
+}
+
 /* Main parsing function */
-command_t *parse_command(char *input, shell_state_t *state)
+static command_t *parse_chain(char *input, shell_state_t *state)
 {
     if (!input || !*input) return NULL;
     
@@ -245,10 +546,13 @@ command_t *parse_command(char *input, shell_state_t *state)
         
         command_t *cmd = parse_single_command(&pos, state);
         if (!cmd) {
-            /* If parsing failed, skip to next operator or end */
+            /* If parsing failed, skip past the next operator or to end */
             while (*pos && !is_operator_char(*pos)) {
                 pos++;
             }
+            if (*pos && *pos != '#') {
+                pos++;
+            }
             continue;
         }
         
@@ -280,6 +584,16 @@ command_t *parse_command(char *input, shell_state_t *state)
     return head;
 }
 
+command_t *parse_command(char *input, shell_state_t *state)
+{
+    if (state == NULL) return parse_chain(input, state);
+    
+    long start = metrics_now_ns();
+    command_t *cmd = parse_chain(input, state);
+    metrics_add_parse(state, metrics_now_ns() - start);
+    return cmd;
+}
+
 void free_command(command_t *cmd)
 {
     if (!cmd) return;
@@ -292,10 +606,11 @@ void free_command(command_t *cmd)
         free(cmd->args);
     }
     
-    /* Free output file */
-    if (cmd->output_file) {
-        free(cmd->output_file);
-    }
+    free(cmd->literal);
+    
+    /* Free redirections and process substitutions */
+    free_redirections(cmd->redirs);
+    free_procsubs(cmd->procsubs);
     
     /* Recursively free next commands */
     if (cmd->next) {
@@ -9,6 +9,7 @@ void init_path(shell_state_t *state)
         return;
     }
     state->path_dirs[0] = my_strdup("/bin");
+    state->path_generation++;
 }
 
 char *find_command_in_path(char *cmd, shell_state_t *state)
@@ -16,12 +17,19 @@ char *find_command_in_path(char *cmd, shell_state_t *state)
     /* Check if command contains a slash (absolute or relative path) */
     if (strchr(cmd, '/') != NULL) {
         /* Absolute or relative path */
+        state->metrics.path_probes++;
         if (access(cmd, F_OK) == 0) {
             return my_strdup(cmd);
         }
         return NULL;
     }
     
+    /* The script's commands may have been looked up already */
+    const char *known = prescan_lookup(state, cmd);
+    if (known != NULL) {
+        return my_strdup(known);
+    }
+    
     /* Search in PATH directories */
     for (int i = 0; i < state->path_count; i++) {
         if (state->path_dirs[i] == NULL) {
@@ -42,6 +50,7 @@ char *find_command_in_path(char *cmd, shell_state_t *state)
         snprintf(full_path, total_len, "%s/%s", state->path_dirs[i], cmd);
         
         /* Check if file exists */
+        state->metrics.path_probes++;
         if (access(full_path, F_OK) == 0) {
             return full_path;
         }
@@ -74,4 +83,5 @@ void set_path(char **paths, int count, shell_state_t *state)
     } else {
         state->path_dirs = NULL;
     }
+    state->path_generation++;
 }
\ No newline at end of file
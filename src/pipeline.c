@@ -0,0 +1,256 @@
+/* src/pipeline.c - Read and parse batch lines ahead of execution
+ *
+ * A reader thread reads the batch file, frames here-document bodies and
+ * parses every line whose parse cannot depend on shell state, pushing
+ * the results into a bounded single-producer/single-consumer ring. The
+ * main thread pops and executes them; lines that do depend on state
+ * (variables, substitutions) are handed over as text and parsed only
+ * when their turn comes, after earlier lines have run.
+ */
+
+#include "../include/shell.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/* Lines buffered ahead of execution (power of two) */
+#define PIPELINE_RING_SIZE 256
+
+struct pipeline_s {
+    input_line_t *slots[PIPELINE_RING_SIZE];
+    _Atomic uint32_t head;      /* Next slot to consume (main thread) */
+    _Atomic uint32_t tail;      /* Next slot to fill (reader thread) */
+    _Atomic int stop;           /* Main thread wants the reader gone */
+    int done;                   /* Reader pushed its end marker */
+    FILE *fp;
+    int lineno;                 /* Lines read so far (reader thread) */
+    pthread_t thread;
+};
+
+/* Sleep while *addr still holds val (or until the timeout, if any) */
+static void futex_wait(_Atomic uint32_t *addr, uint32_t val,
+    const struct timespec *timeout)
+{
+    syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT_PRIVATE, val, timeout,
+        NULL, 0);
+}
+
+/* Wake the thread sleeping on addr */
+static void futex_wake(_Atomic uint32_t *addr)
+{
+    syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/* Reader: push one item, waiting while the ring is full */
+static int ring_push(struct pipeline_s *p, input_line_t *line)
+{
+    /* Bounded sleeps, so a stop request racing with the wait is seen */
+    const struct timespec recheck = { 0, 50 * 1000 * 1000 };
+    uint32_t tail = atomic_load_explicit(&p->tail, memory_order_relaxed);
+
+    for (;;) {
+        uint32_t head = atomic_load_explicit(&p->head, memory_order_acquire);
+        if (atomic_load(&p->stop)) return -1;
+        if (tail - head < PIPELINE_RING_SIZE) break;
+        futex_wait(&p->head, head, &recheck);
+    }
+
+    p->slots[tail % PIPELINE_RING_SIZE] = line;
+    atomic_store_explicit(&p->tail, tail + 1, memory_order_release);
+    futex_wake(&p->tail);
+    return 0;
+}
+
+/* Main thread: wait while the ring is empty; returns the head index */
+static uint32_t ring_wait(struct pipeline_s *p)
+{
+    uint32_t head = atomic_load_explicit(&p->head, memory_order_relaxed);
+
+    for (;;) {
+        uint32_t tail = atomic_load_explicit(&p->tail, memory_order_acquire);
+        if (tail != head) return head;
+        futex_wait(&p->tail, tail, NULL);
+    }
+}
+
+/* Main thread: pop one item, waiting while the ring is empty */
+static input_line_t *ring_pop(struct pipeline_s *p)
+{
+    uint32_t head = ring_wait(p);
+    input_line_t *line = p->slots[head % PIPELINE_RING_SIZE];
+    atomic_store_explicit(&p->head, head + 1, memory_order_release);
+    futex_wake(&p->head);
+    return line;
+}
+
+/* Read one raw line from the batch file */
+static char *read_raw_line(struct pipeline_s *p)
+{
+    char *text = read_script_line(p->fp);
+    if (text != NULL) p->lineno++;
+    return text;
+}
+
+/* read_raw_line() for join_loop_lines() and read_heredoc_lines() */
+static char *read_loop_line(void *p)
+{
+    return read_raw_line(p);
+}
+
+/* Gather the raw lines that the here-documents on this line consume,
+ * exactly as collect_heredocs() would read them; read_more supplies
+ * them, as for join_loop_lines(). Shared by every reader that reads a
+ * script ahead of running it (pipeline, -j, source) */
+void read_heredoc_lines(input_line_t *line, char *(*read_more)(void *), void *ctx)
+{
+    int delim_count;
+    char **delims = scan_heredoc_delimiters(line->text, &delim_count);
+    int capacity = line->heredoc_count;
+
+    for (int i = 0; i < delim_count; i++) {
+        for (;;) {
+            char *raw = read_more(ctx);
+            if (raw == NULL) break;
+
+            if (line->heredoc_count >= capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                char **grown = realloc(line->heredoc_lines,
+                    capacity * sizeof(char *));
+                if (grown == NULL) {
+                    free(raw);
+                    break;
+                }
+                line->heredoc_lines = grown;
+            }
+            line->heredoc_lines[line->heredoc_count++] = raw;
+
+            if (strcmp(raw, delims[i]) == 0) break;
+        }
+    }
+
+    free_string_array(delims);
+}
+
+/* Reader thread body */
+static void *reader_main(void *arg)
+{
+    struct pipeline_s *p = arg;
+
+    /* Errors from speculative parses are reported by the re-parse */
+    set_errors_quiet(1);
+
+    for (;;) {
+        char *text = read_raw_line(p);
+        if (text == NULL) break;
+
+        if (text[0] == '\0' || text[0] == '#') {
+            free(text);
+            continue;
+        }
+
+        input_line_t *line = calloc(1, sizeof(input_line_t));
+        if (line == NULL) {
+            free(text);
+            break;
+        }
+        line->lineno = p->lineno;
+
+        /* A loop travels as one item, parsed when it runs */
+        if (loop_depth(text) > 0) {
+            text = join_loop_lines(text, read_loop_line, p);
+        }
+        line->text = text;
+
+        /* State-independent lines never consult the shell state; loops
+         * are parsed by run_loop() when they run */
+        if (!starts_loop(text)) {
+            if (parse_is_static(text)) {
+                long start = metrics_now_ns();
+                line->cmd = parse_command(text, NULL);
+                line->parse_ns = metrics_now_ns() - start;
+            }
+            read_heredoc_lines(line, read_loop_line, p);
+        }
+
+        if (ring_push(p, line) != 0) {
+            free_input_line(line);
+            return NULL;
+        }
+    }
+
+    /* End-of-input marker */
+    ring_push(p, NULL);
+    return NULL;
+}
+
+/* Start the reader thread on the batch file */
+int pipeline_start(shell_state_t *state)
+{
+    struct pipeline_s *p = calloc(1, sizeof(struct pipeline_s));
+    if (p == NULL) return -1;
+
+    p->fp = state->batch_fp;
+    if (pthread_create(&p->thread, NULL, reader_main, p) != 0) {
+        free(p);
+        return -1;
+    }
+
+    state->pipeline = p;
+    return 0;
+}
+
+/* Next line to execute, or NULL at end of input */
+input_line_t *pipeline_next(shell_state_t *state)
+{
+    struct pipeline_s *p = state->pipeline;
+    if (p->done) return NULL;
+
+    input_line_t *line = ring_pop(p);
+    if (line == NULL) p->done = 1;
+    return line;
+}
+
+/* Is the next item the end of input? Waits for the reader if needed */
+int pipeline_at_end(shell_state_t *state)
+{
+    struct pipeline_s *p = state->pipeline;
+    if (p->done) return 1;
+
+    return p->slots[ring_wait(p) % PIPELINE_RING_SIZE] == NULL;
+}
+
+/* Stop the reader (possibly early, e.g. on exit) and free what it read */
+void pipeline_stop(shell_state_t *state)
+{
+    struct pipeline_s *p = state->pipeline;
+    if (p == NULL) return;
+
+    atomic_store(&p->stop, 1);
+    futex_wake(&p->head);
+    pthread_join(p->thread, NULL);
+
+    uint32_t head = atomic_load(&p->head);
+    uint32_t tail = atomic_load(&p->tail);
+    for (; head != tail; head++) {
+        free_input_line(p->slots[head % PIPELINE_RING_SIZE]);
+    }
+
+    free(p);
+    state->pipeline = NULL;
+}
+
+/* Free a read-ahead line */
+void free_input_line(input_line_t *line)
+{
+    if (line == NULL) return;
+
+    free(line->text);
+    free_command(line->cmd);
+    for (int i = 0; i < line->heredoc_count; i++) {
+        free(line->heredoc_lines[i]);
+    }
+    free(line->heredoc_lines);
+    free(line);
+}
\ No newline at end of file
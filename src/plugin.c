@@ -0,0 +1,193 @@
+/* src/plugin.c - Builtins loaded from shared objects
+ *
+ *     enable -f lib.so NAME...   load NAME's descriptor from lib.so
+ *     enable -d NAME...          remove loaded builtins
+ *     enable                     list loaded builtins
+ *
+ * Each NAME is looked up as the symbol oshell_builtin_NAME (see
+ * include/oshell_plugin.h). Loaded builtins are found after the
+ * compiled-in ones and run in-process like them. A library stays
+ * loaded once opened: its code may be referenced by other builtins.
+ */
+
+#include "../include/shell.h"
+#include "../include/oshell_plugin.h"
+#include <dlfcn.h>
+
+#define MAX_PLUGINS 64
+
+typedef struct plugin_s {
+    char *name;
+    const oshell_builtin_t *builtin;
+} plugin_t;
+
+/* Builtins are looked up by name alone, without the shell state */
+static plugin_t plugins[MAX_PLUGINS];
+static int plugin_count;
+static long generation;             /* Bumped whenever the set of names changes */
+
+static plugin_t *find_plugin(const char *name)
+{
+    for (int i = 0; i < plugin_count; i++) {
+        if (strcmp(plugins[i].name, name) == 0) return &plugins[i];
+    }
+    return NULL;
+}
+
+/* Name of the index-th loaded builtin, or NULL past the last */
+const char *plugin_name(int index)
+{
+    return index >= 0 && index < plugin_count ? plugins[index].name : NULL;
+}
+
+/* Changes whenever a builtin is loaded or removed (see complete.c) */
+long plugin_generation(void)
+{
+    return generation;
+}
+
+/* Is name a loaded builtin? */
+int is_plugin(const char *name)
+{
+    return find_plugin(name) != NULL;
+}
+
+static const char *ctx_get_var(oshell_ctx_t *ctx, const char *name)
+{
+    const char *value = get_shell_var(ctx->shell, name);
+    return value != NULL ? value : getenv(name);
+}
+
+static int ctx_set_var(oshell_ctx_t *ctx, const char *name, const char *value)
+{
+    return set_shell_var(ctx->shell, name, value);
+}
+
+/* Run a loaded builtin */
+int run_plugin(command_t *cmd, shell_state_t *state)
+{
+    plugin_t *p = find_plugin(cmd->args[0]);
+    if (p == NULL) return 1;
+
+    oshell_ctx_t ctx = {
+        .abi_version = OSHELL_PLUGIN_ABI,
+        .out = state->out,
+        .err = stderr,
+        .get_var = ctx_get_var,
+        .set_var = ctx_set_var,
+        .shell = state,
+    };
+
+    int argc = 0;
+    while (cmd->args[argc] != NULL) argc++;
+    return p->builtin->run(&ctx, argc, cmd->args);
+}
+
+/* Load NAME from an opened library */
+static int load_builtin(void *lib, const char *file, const char *name)
+{
+    char symbol[256];
+    snprintf(symbol, sizeof(symbol), "oshell_builtin_%s", name);
+
+    const oshell_builtin_t *b = dlsym(lib, symbol);
+    if (b == NULL) {
+        fprintf(stderr, "enable: %s: no builtin %s\n", file, name);
+        return 1;
+    }
+    if (b->abi_version < 1 || b->abi_version > OSHELL_PLUGIN_ABI || b->run == NULL) {
+        fprintf(stderr, "enable: %s: %s was built for plugin ABI %d, not %d\n",
+            file, name, b->abi_version, OSHELL_PLUGIN_ABI);
+        return 1;
+    }
+    if (is_builtin((char *)name) && find_plugin(name) == NULL) {
+        fprintf(stderr, "enable: %s: cannot replace a shell builtin\n", name);
+        return 1;
+    }
+
+    plugin_t *p = find_plugin(name);
+    if (p == NULL) {
+        if (plugin_count >= MAX_PLUGINS) {
+            fprintf(stderr, "enable: too many loaded builtins\n");
+            return 1;
+        }
+        p = &plugins[plugin_count++];
+        p->name = my_strdup(name);
+        generation++;
+    }
+    p->builtin = b;
+    return 0;
+}
+
+/* Forget a loaded builtin */
+static int unload_builtin(const char *name)
+{
+    plugin_t *p = find_plugin(name);
+    if (p == NULL) {
+        fprintf(stderr, "enable: %s: not a loaded builtin\n", name);
+        return 1;
+    }
+    free(p->name);
+    *p = plugins[--plugin_count];
+    generation++;
+    return 0;
+}
+
+/* Built-in: enable [-f lib.so NAME... | -d NAME...] */
+int builtin_enable(command_t *cmd, shell_state_t *state)
+{
+    int status = 0;
+
+    if (cmd->args[1] == NULL) {
+        for (int i = 0; i < plugin_count; i++) {
+            fprintf(state->out, "%s\t%s\n", plugins[i].name,
+                plugins[i].builtin->usage ? plugins[i].builtin->usage : "");
+        }
+        return 0;
+    }
+
+    if (strcmp(cmd->args[1], "-d") == 0) {
+        for (int i = 2; cmd->args[i] != NULL; i++) {
+            status |= unload_builtin(cmd->args[i]);
+        }
+        return status;
+    }
+
+    if (strcmp(cmd->args[1], "-f") != 0 || cmd->args[2] == NULL || cmd->args[3] == NULL) {
+        fprintf(stderr, "enable: usage: enable [-f lib.so name... | -d name...]\n");
+        return 1;
+    }
+
+    /* A bare name would be searched for on the library path */
+    const char *file = cmd->args[2];
+    char path[MAX_PATH_LEN];
+    if (strchr(file, '/') == NULL) {
+        snprintf(path, sizeof(path), "./%s", file);
+        file = path;
+    }
+
+    void *lib = dlopen(file, RTLD_NOW | RTLD_LOCAL);
+    if (lib == NULL) {
+        fprintf(stderr, "enable: %s\n", dlerror());
+        return 1;
+    }
+    int loaded = 0;
+    for (int i = 3; cmd->args[i] != NULL; i++) {
+        if (load_builtin(lib, cmd->args[2], cmd->args[i]) == 0) {
+            loaded++;
+        } else {
+            status = 1;
+        }
+    }
+    if (loaded == 0) dlclose(lib);
+    return status;
+}
+
+/* Forget every loaded builtin */
+void free_plugins(void)
+{
+    for (int i = 0; i < plugin_count; i++) {
+        free(plugins[i].name);
+    }
+    plugin_count = 0;
+    generation++;
+}
\ No newline at end of file
@@ -0,0 +1,282 @@
+/* src/prescan.c - Resolve a batch script's commands ahead of time
+ *
+ * With --prescan, init_shell() reads the script once before running it
+ * (a regular file or -c string; a pipe can only be read once),
+ * collects the distinct command names in it (first words of commands,
+ * and of loop conditions and bodies), and looks them up in path_dirs on
+ * a few threads at once. On a slow or cold filesystem the lookups then
+ * overlap instead of each command's first use paying for a serial walk.
+ * find_command_in_path() answers from the table while path_dirs is the
+ * one it was built for (path_generation); `path` makes it stale.
+ *
+ * Only commands that were found are recorded, so one that appears
+ * later (built by the script itself) is still found by a normal walk.
+ */
+
+#include "../include/shell.h"
+#include <pthread.h>
+
+#define PRESCAN_DEFAULT_THREADS 4
+#define PRESCAN_MAX_THREADS 16
+
+typedef struct prescan_entry_s {
+    char *name;
+    char *path;                 /* Where it was found, or NULL */
+} prescan_entry_t;
+
+struct prescan_s {
+    long path_generation;       /* path_dirs the table is valid for */
+    prescan_entry_t *entries;   /* Sorted by name */
+    int count;
+};
+
+/* Work shared by the resolver threads */
+typedef struct resolve_job_s {
+    prescan_entry_t *entries;
+    int count;
+    int next;                   /* Next entry to take (atomic) */
+    char **dirs;
+    int dir_count;
+    long probes;                /* Paths tried, summed (atomic) */
+} resolve_job_t;
+
+static int compare_entries(const void *a, const void *b)
+{
+    return strcmp(((const prescan_entry_t *)a)->name, ((const prescan_entry_t *)b)->name);
+}
+
+/* Words that introduce a command rather than name one */
+static int is_keyword(const char *word, size_t len)
+{
+    static const char *const keywords[] = { "while", "do", "done", "time", NULL };
+
+    for (int i = 0; keywords[i] != NULL; i++) {
+        if (strlen(keywords[i]) == len && strncmp(word, keywords[i], len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Add name to the (unsorted, possibly duplicated) list */
+static void add_name(prescan_entry_t **entries, int *count, int *capacity,
+    const char *word, size_t len)
+{
+    if (*count >= *capacity) {
+        int grown_capacity = *capacity ? *capacity * 2 : 64;
+        prescan_entry_t *grown = realloc(*entries, grown_capacity * sizeof(prescan_entry_t));
+        if (grown == NULL) return;
+        *entries = grown;
+        *capacity = grown_capacity;
+    }
+    char *name = strndup(word, len);
+    if (name == NULL) return;
+    (*entries)[*count].name = name;
+    (*entries)[*count].path = NULL;
+    (*count)++;
+}
+
+/* Collect the command names in one line of the script */
+static void scan_line(const char *line, prescan_entry_t **entries, int *count,
+    int *capacity)
+{
+    const char *p = line;
+    int command_start = 1;
+
+    while (*p != '\0' && *p != '#') {
+        if (*p == ' ' || *p == '\t' || *p == '\n') {
+            p++;
+            continue;
+        }
+        if (strchr(";&|(", *p) != NULL && !(*p == '&' && p > line &&
+            (p[-1] == '>' || p[-1] == '<'))) {
+            command_start = 1;
+            p++;
+            continue;
+        }
+        if (*p == '\'' || *p == '"') {
+            /* Skip quoted text; a name is never quoted here */
+            const char *close = strchr(p + 1, *p);
+            p = close ? close + 1 : p + strlen(p);
+            command_start = 0;
+            continue;
+        }
+
+        const char *word = p;
+        while (*p != '\0' && strchr(" \t\n;&|()'\"<>#", *p) == NULL) p++;
+        if (p == word) {
+            p++;                /* A redirection operator */
+            continue;
+        }
+        size_t len = p - word;
+
+        if (!command_start) continue;
+        if (is_keyword(word, len)) continue;
+        command_start = 0;
+
+        /* Names with expansions or paths are not looked up in PATH */
+        if (memchr(word, '$', len) || memchr(word, '`', len) ||
+            memchr(word, '/', len) || memchr(word, '=', len)) {
+            continue;
+        }
+        char name[256];
+        if (len >= sizeof(name)) continue;
+        memcpy(name, word, len);
+        name[len] = '\0';
+        if (is_builtin(name)) continue;
+
+        add_name(entries, count, capacity, word, len);
+    }
+}
+
+/* Thread body: resolve entries until none are left */
+static void *resolve_main(void *arg)
+{
+    resolve_job_t *job = arg;
+    long probes = 0;
+
+    for (;;) {
+        int i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->count) break;
+
+        prescan_entry_t *e = &job->entries[i];
+        for (int d = 0; d < job->dir_count && e->path == NULL; d++) {
+            char path[MAX_PATH_LEN];
+            snprintf(path, sizeof(path), "%s/%s", job->dirs[d], e->name);
+            probes++;
+            if (access(path, F_OK) == 0) {
+                e->path = my_strdup(path);
+            }
+        }
+    }
+
+    __atomic_fetch_add(&job->probes, probes, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+/* Resolve every command name in the script text at once */
+static struct prescan_s *build_table(shell_state_t *state, FILE *fp)
+{
+    prescan_entry_t *entries = NULL;
+    int count = 0;
+    int capacity = 0;
+    char line[MAX_INPUT];
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        scan_line(line, &entries, &count, &capacity);
+    }
+    if (count == 0) {
+        free(entries);
+        return NULL;
+    }
+
+    /* Sort and drop duplicates */
+    qsort(entries, count, sizeof(prescan_entry_t), compare_entries);
+    int unique = 0;
+    for (int i = 0; i < count; i++) {
+        if (unique > 0 && strcmp(entries[unique - 1].name, entries[i].name) == 0) {
+            free(entries[i].name);
+        } else {
+            entries[unique++] = entries[i];
+        }
+    }
+    count = unique;
+
+    resolve_job_t job = {
+        .entries = entries,
+        .count = count,
+        .dirs = state->path_dirs,
+        .dir_count = state->path_count,
+    };
+
+    const char *env = getenv("OSHELL_PRESCAN_THREADS");
+    int threads = env ? atoi(env) : PRESCAN_DEFAULT_THREADS;
+    if (threads < 1) threads = 1;
+    if (threads > PRESCAN_MAX_THREADS) threads = PRESCAN_MAX_THREADS;
+    if (threads > count) threads = count;
+
+    pthread_t tids[PRESCAN_MAX_THREADS];
+    int started = 0;
+    for (; started < threads - 1; started++) {
+        if (pthread_create(&tids[started], NULL, resolve_main, &job) != 0) break;
+    }
+    resolve_main(&job);
+    for (int i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    state->metrics.path_probes += job.probes;
+
+    struct prescan_s *table = calloc(1, sizeof(struct prescan_s));
+    if (table == NULL) {
+        for (int i = 0; i < count; i++) {
+            free(entries[i].name);
+            free(entries[i].path);
+        }
+        free(entries);
+        return NULL;
+    }
+    table->entries = entries;
+    table->count = count;
+    table->path_generation = state->path_generation;
+    return table;
+}
+
+/* Build the table for the batch script, if there is one. The script is
+ * read through its own stream and rewound, and only when it can be: a
+ * pipe or FIFO would be consumed before the shell got to run it */
+void prescan_script(shell_state_t *state)
+{
+    FILE *fp = state->batch_fp;
+    struct stat st;
+
+    if (state->mode != MODE_BATCH || fp == NULL) return;
+    /* fmemopen (-c) streams have no descriptor and always rewind */
+    if (fileno(fp) >= 0 && (fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode))) {
+        return;
+    }
+    long start = ftell(fp);
+    if (start < 0) return;
+
+    prescan_free(state);
+    state->prescan = build_table(state, fp);
+    if (fseek(fp, start, SEEK_SET) != 0) {
+        print_error();
+        exit(1);
+    }
+}
+
+/* Path the prescan found for name (owned by the table), or NULL if it
+ * has no answer */
+const char *prescan_lookup(shell_state_t *state, const char *name)
+{
+    struct prescan_s *table = state->prescan;
+
+    if (table == NULL) return NULL;
+    if (table->path_generation != state->path_generation) {
+        prescan_free(state);
+        return NULL;
+    }
+
+    prescan_entry_t key = { .name = (char *)name };
+    prescan_entry_t *e = bsearch(&key, table->entries, table->count,
+        sizeof(prescan_entry_t), compare_entries);
+    if (e == NULL || e->path == NULL) return NULL;
+
+    state->metrics.prescan_hits++;
+    return e->path;
+}
+
+/* Drop the table */
+void prescan_free(shell_state_t *state)
+{
+    struct prescan_s *table = state->prescan;
+    if (table == NULL) return;
+
+    for (int i = 0; i < table->count; i++) {
+        free(table->entries[i].name);
+        free(table->entries[i].path);
+    }
+    free(table->entries);
+    free(table);
+    state->prescan = NULL;
+}
\ No newline at end of file
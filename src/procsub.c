@@ -0,0 +1,124 @@
+/* src/procsub.c - Process substitution: <(cmd) and >(cmd) via /dev/fd */
+
+#include "../include/shell.h"
+
+/* Close the shell's ends of substitutions started before `stop` */
+static void close_fds_until(command_t *cmd, procsub_t *stop)
+{
+    for (procsub_t *ps = cmd->procsubs; ps != stop; ps = ps->next) {
+        if (ps->fd >= 0) {
+            close(ps->fd);
+            ps->fd = -1;
+        }
+    }
+}
+
+/* Start every substitution of cmd concurrently and replace each
+ * placeholder argument with the /dev/fd path of its pipe */
+int start_procsubs(command_t *cmd, shell_state_t *state)
+{
+    for (procsub_t *ps = cmd->procsubs; ps != NULL; ps = ps->next) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            print_error();
+            return -1;
+        }
+
+        /* The child uses one end, the command inherits the other */
+        int child_end = ps->output ? fds[0] : fds[1];
+        int shell_end = ps->output ? fds[1] : fds[0];
+
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid > 0) state->metrics.forks++;
+        if (pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            print_error();
+            return -1;
+        }
+
+        if (pid == 0) {
+            /* Child: run the substitution on the pipe */
+            close(shell_end);
+            close_fds_until(cmd, ps);
+            if (dup2(child_end, ps->output ? STDIN_FILENO : STDOUT_FILENO) < 0) {
+                _exit(1);
+            }
+            close(child_end);
+
+            command_t *sub = parse_command(ps->text, state);
+            if (sub != NULL) {
+                collect_heredocs(sub, state);
+                state->exec_tail = 1;
+                execute_command(sub, state);
+            }
+            fflush(stdout);
+            _exit(state->last_exit_status);
+        }
+
+        close(child_end);
+        ps->fd = shell_end;
+        ps->pid = pid;
+        job_add(state, pid, ps->text);
+
+        char path[32];
+        snprintf(path, sizeof(path), "/dev/fd/%d", shell_end);
+        char *arg = my_strdup(path);
+        if (arg == NULL) {
+            print_error();
+            return -1;
+        }
+        if (ps->redir != NULL) {
+            free(ps->redir->target);
+            ps->redir->target = arg;
+        } else {
+            free(cmd->args[ps->arg_index]);
+            cmd->args[ps->arg_index] = arg;
+        }
+    }
+
+    return 0;
+}
+
+/* Drop the shell's copies once the command has inherited them */
+void close_procsub_fds(command_t *cmd)
+{
+    close_fds_until(cmd, NULL);
+}
+
+/* Reap the substitution children and expose their exit statuses,
+ * in argument order, as $PROCSUB_STATUS */
+void wait_procsubs(command_t *cmd, shell_state_t *state)
+{
+    char statuses[256] = "";
+    size_t used = 0;
+
+    close_procsub_fds(cmd);
+
+    for (procsub_t *ps = cmd->procsubs; ps != NULL; ps = ps->next) {
+        if (ps->pid <= 0) continue;
+
+        int status = job_wait(state, ps->pid);
+        ps->pid = 0;
+
+        if (used < sizeof(statuses)) {
+            used += snprintf(statuses + used, sizeof(statuses) - used,
+                used ? " %d" : "%d", status);
+        }
+    }
+
+    set_shell_var(state, "PROCSUB_STATUS", statuses);
+}
+
+/* Free a process substitution list */
+void free_procsubs(procsub_t *procsubs)
+{
+    while (procsubs != NULL) {
+        procsub_t *next = procsubs->next;
+        if (procsubs->fd >= 0) close(procsubs->fd);
+        free(procsubs->text);
+        free(procsubs);
+        procsubs = next;
+    }
+}
\ No newline at end of file
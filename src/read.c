@@ -0,0 +1,298 @@
+/* src/read.c - read builtin with per-descriptor buffering
+ *
+ * Traditional shells read one byte per read() call so they never consume
+ * input past the newline. Here each descriptor gets a 64K buffer that is
+ * kept between calls. On a seekable descriptor the file offset is moved
+ * back to just after the line that was returned, so commands run
+ * afterwards still see the rest of the input, and the buffer is dropped
+ * if something else moved the offset. Input read ahead from a pipe or
+ * terminal cannot be put back: it stays buffered for the next read, and
+ * other commands reading the same pipe do not see it.
+ */
+
+#include "../include/shell.h"
+
+#define READ_BUFFER_SIZE (64 * 1024)
+
+#define DEFAULT_IFS " \t\n"
+
+struct read_buffer_s {
+    int fd;
+    dev_t dev;                  /* File the buffered data came from */
+    ino_t ino;
+    int seekable;
+    off_t offset;               /* File offset of data[start] (seekable) */
+    off_t fd_offset;            /* Where the descriptor is (seekable) */
+    char *data;
+    size_t start;               /* Unconsumed bytes are data[start..len) */
+    size_t len;
+    struct read_buffer_s *next;
+};
+
+/* Buffer for fd and the file it now refers to. A pipe's buffer is kept
+ * while fd points elsewhere (done < <(...) inside another such loop);
+ * a seekable file's is not needed, as its offset was put back */
+static struct read_buffer_s *get_buffer(shell_state_t *state, int fd)
+{
+    struct read_buffer_s *r;
+    struct read_buffer_s *spare = NULL;
+    struct stat st;
+
+    if (fstat(fd, &st) != 0) return NULL;
+
+    for (r = state->read_buffers; r != NULL; r = r->next) {
+        if (r->fd != fd) continue;
+        if (r->dev == st.st_dev && r->ino == st.st_ino) break;
+        if (r->start == r->len || r->seekable) spare = r;
+    }
+    if (r == NULL && spare != NULL) {
+        r = spare;
+        r->start = r->len = 0;
+    }
+    if (r == NULL) {
+        r = calloc(1, sizeof(struct read_buffer_s));
+        if (r == NULL) return NULL;
+        r->data = malloc(READ_BUFFER_SIZE);
+        if (r->data == NULL) {
+            free(r);
+            return NULL;
+        }
+        r->fd = fd;
+        r->next = state->read_buffers;
+        state->read_buffers = r;
+    }
+    r->dev = st.st_dev;
+    r->ino = st.st_ino;
+
+    /* Someone else moved the offset: what we hold is stale */
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+    r->seekable = pos >= 0;
+    if (r->seekable && pos != r->offset) {
+        r->start = r->len = 0;
+        r->offset = pos;
+    }
+    r->fd_offset = pos;
+    return r;
+}
+
+/* Append the next line (without its newline) to line; returns 1 if a
+ * newline ended it, 0 at end of input and -1 on a read error */
+static int buffered_line(struct read_buffer_s *r, buffer_t *line)
+{
+    int result;
+
+    for (;;) {
+        char *data = r->data + r->start;
+        size_t avail = r->len - r->start;
+        char *nl = memchr(data, '\n', avail);
+
+        if (nl != NULL) {
+            buf_append(line, data, nl - data);
+            r->start += nl - data + 1;
+            r->offset += nl - data + 1;
+            result = 1;
+            break;
+        }
+        buf_append(line, data, avail);
+        r->offset += avail;
+        r->start = r->len = 0;
+
+        ssize_t n = read(r->fd, r->data, READ_BUFFER_SIZE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            result = n < 0 ? -1 : 0;
+            break;
+        }
+        r->len = n;
+        r->fd_offset += n;
+    }
+
+    /* Leave the descriptor just past what was consumed */
+    if (r->seekable && r->fd_offset != r->offset) {
+        lseek(r->fd, r->offset, SEEK_SET);
+        r->fd_offset = r->offset;
+    }
+    return result;
+}
+
+/* Append n bytes to text, keeping escaped (when in use) in step */
+static void append_plain(buffer_t *text, buffer_t *escaped, const char *s, size_t n)
+{
+    buf_append(text, s, n);
+    if (escaped->len > 0) {
+        while (escaped->len < text->len) buf_append(escaped, "", 1);
+    }
+}
+
+/* Read a logical line into text; without raw, a backslash escapes the
+ * next character (marked in escaped, which stays empty until the first
+ * escape) and a trailing one continues the line on the next */
+static int read_logical_line(struct read_buffer_s *r, int raw, buffer_t *text,
+    buffer_t *escaped)
+{
+    buffer_t line;
+    int result;
+
+    buf_init(&line);
+    for (;;) {
+        line.len = 0;
+        result = buffered_line(r, &line);
+        if (result < 0) break;
+
+        if (raw || line.len == 0 || memchr(line.data, '\\', line.len) == NULL) {
+            append_plain(text, escaped, line.data, line.len);
+            break;
+        }
+
+        int continued = 0;
+        for (size_t i = 0; i < line.len; i++) {
+            if (line.data[i] != '\\') {
+                append_plain(text, escaped, &line.data[i], 1);
+                continue;
+            }
+            if (i + 1 == line.len) {
+                continued = result == 1;
+                break;
+            }
+            while (escaped->len < text->len) buf_append(escaped, "", 1);
+            buf_append(text, &line.data[++i], 1);
+            buf_append(escaped, "\1", 1);
+        }
+        if (!continued) break;
+    }
+    buf_free(&line);
+    return result;
+}
+
+/* Is c an IFS character, and is it whitespace? */
+static int is_ifs(const char *ifs, char c)
+{
+    return c != '\0' && strchr(ifs, c) != NULL;
+}
+
+static int is_ifs_space(const char *ifs, char c)
+{
+    return is_ifs(ifs, c) && (c == ' ' || c == '\t' || c == '\n');
+}
+
+/* Split text on IFS into the named variables; the last one gets the
+ * rest of the line */
+static void assign_fields(shell_state_t *state, char **names, buffer_t *text,
+    buffer_t *escaped)
+{
+    const char *ifs = get_shell_var(state, "IFS");
+    if (ifs == NULL) ifs = getenv("IFS");
+    if (ifs == NULL) ifs = DEFAULT_IFS;
+
+    const char *s = text->data ? text->data : "";
+    const char *esc = escaped->len > 0 ? escaped->data : NULL;
+    size_t len = text->len;
+    size_t pos = 0;
+
+#define DELIM(i) ((esc == NULL || !esc[i]) && is_ifs(ifs, s[i]))
+#define SPACE(i) ((esc == NULL || !esc[i]) && is_ifs_space(ifs, s[i]))
+
+    while (pos < len && SPACE(pos)) pos++;
+
+    for (int v = 0; names[v] != NULL; v++) {
+        size_t end;
+
+        if (names[v + 1] == NULL) {
+            /* Last variable: everything left, less trailing IFS space */
+            end = len;
+            while (end > pos && SPACE(end - 1)) end--;
+        } else {
+            end = pos;
+            while (end < len && !DELIM(end)) end++;
+        }
+
+        char *field = malloc(end - pos + 1);
+        if (field != NULL) {
+            memcpy(field, s + pos, end - pos);
+            field[end - pos] = '\0';
+            set_shell_var(state, names[v], field);
+            free(field);
+        }
+
+        /* Step over one delimiter and the IFS space around it */
+        pos = end;
+        while (pos < len && SPACE(pos)) pos++;
+        if (pos < len && DELIM(pos)) {
+            pos++;
+            while (pos < len && SPACE(pos)) pos++;
+        }
+    }
+
+#undef DELIM
+#undef SPACE
+}
+
+/* Built-in: read [-r] [-u FD] [VAR...] - read a line into variables */
+int builtin_read(command_t *cmd, shell_state_t *state)
+{
+    static char *reply[] = { "REPLY", NULL };
+    int raw = 0;
+    int fd = STDIN_FILENO;
+    int i = 1;
+
+    for (; cmd->args[i] != NULL && cmd->args[i][0] == '-'; i++) {
+        if (strcmp(cmd->args[i], "-r") == 0) {
+            raw = 1;
+        } else if (strcmp(cmd->args[i], "-u") == 0 && cmd->args[i + 1] != NULL) {
+            char *end;
+            fd = (int)strtol(cmd->args[++i], &end, 10);
+            if (*end != '\0' || fd < 0) fd = -1;
+        } else if (strcmp(cmd->args[i], "--") == 0) {
+            i++;
+            break;
+        } else {
+            fd = -1;
+        }
+        if (fd < 0) {
+            fprintf(stderr, "read: usage: read [-r] [-u fd] [name...]\n");
+            return 1;
+        }
+    }
+    char **names = cmd->args[i] != NULL ? &cmd->args[i] : reply;
+
+    struct read_buffer_s *r = get_buffer(state, fd);
+    if (r == NULL) {
+        fprintf(stderr, "read: %d: %s\n", fd, strerror(errno));
+        return 1;
+    }
+
+    buffer_t text, escaped;
+    buf_init(&text);
+    buf_init(&escaped);
+    int result = read_logical_line(r, raw, &text, &escaped);
+    if (result < 0) {
+        fprintf(stderr, "read: %s\n", strerror(errno));
+    }
+
+    if (names == reply) {
+        /* REPLY keeps the line as read */
+        set_shell_var(state, "REPLY", text.data ? text.data : "");
+    } else {
+        assign_fields(state, names, &text, &escaped);
+    }
+
+    buf_free(&text);
+    buf_free(&escaped);
+
+    /* A last line without a newline is assigned but ends the input */
+    return result == 1 ? 0 : 1;
+}
+
+/* Release every descriptor's buffer */
+void free_read_buffers(shell_state_t *state)
+{
+    struct read_buffer_s *r = state->read_buffers;
+
+    while (r != NULL) {
+        struct read_buffer_s *next = r->next;
+        free(r->data);
+        free(r);
+        r = next;
+    }
+    state->read_buffers = NULL;
+}
\ No newline at end of file
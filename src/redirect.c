@@ -0,0 +1,224 @@
+/* src/redirect.c - Applying and undoing redirections, and exec */
+
+#include "../include/shell.h"
+#include <sys/mman.h>
+#include <limits.h>
+
+/* Bodies up to this size fit in a pipe without blocking the writer */
+#define HEREDOC_PIPE_MAX PIPE_BUF
+
+/* Write all of buf to fd */
+static int write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Return a readable descriptor holding body: a pipe for small bodies,
+ * otherwise an anonymous memory file, so nothing touches the disk */
+static int open_body_fd(const char *body)
+{
+    size_t len = strlen(body);
+
+    if (len <= HEREDOC_PIPE_MAX) {
+        int fds[2];
+        if (pipe(fds) != 0) return -1;
+        if (write_all(fds[1], body, len) != 0) {
+            close(fds[0]);
+            close(fds[1]);
+            return -1;
+        }
+        close(fds[1]);
+        return fds[0];
+    }
+
+    int fd = memfd_create("heredoc", MFD_CLOEXEC);
+    if (fd < 0) return -1;
+    if (write_all(fd, body, len) != 0 || lseek(fd, 0, SEEK_SET) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Remember the current target of fd so it can be restored */
+static int save_fd(redir_save_t *save, int fd)
+{
+    if (save == NULL) return 0;
+
+    for (int i = 0; i < save->count; i++) {
+        if (save->fds[i] == fd) return 0;
+    }
+    if (save->count >= MAX_SAVED_FDS) return -1;
+
+    int copy = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+    if (copy < 0 && errno != EBADF) return -1;
+
+    save->fds[save->count] = fd;
+    save->saved[save->count] = copy;
+    save->count++;
+    return 0;
+}
+
+/* Point fd at an already open descriptor and drop the original */
+static int move_to(int src, int fd)
+{
+    if (src == fd) return 0;
+    int result = dup2(src, fd);
+    close(src);
+    return result < 0 ? -1 : 0;
+}
+
+/* Apply redirections in order; if save is not NULL, the original
+ * descriptors are kept so restore_redirections() can undo them */
+int apply_redirections(redirect_t *redirs, redir_save_t *save)
+{
+    if (save != NULL) save->count = 0;
+
+    for (redirect_t *r = redirs; r != NULL; r = r->next) {
+        int src = -1;
+
+        if (save_fd(save, r->fd) != 0 ||
+            (r->type == REDIR_BOTH && save_fd(save, STDERR_FILENO) != 0)) {
+            print_error();
+            return -1;
+        }
+
+        switch (r->type) {
+            case REDIR_IN:
+                src = open(r->target, O_RDONLY);
+                break;
+            case REDIR_OUT:
+            case REDIR_BOTH:
+                src = open(r->target, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                break;
+            case REDIR_APPEND:
+                src = open(r->target, O_WRONLY | O_CREAT | O_APPEND, 0644);
+                break;
+            case REDIR_HEREDOC:
+            case REDIR_HERESTRING:
+                src = open_body_fd(r->body ? r->body : "");
+                break;
+            case REDIR_DUP:
+                if (r->target_fd < 0) {
+                    close(r->fd);
+                    continue;
+                }
+                if (dup2(r->target_fd, r->fd) < 0) {
+                    print_error();
+                    return -1;
+                }
+                continue;
+        }
+
+        if (src < 0) {
+            print_error();
+            return -1;
+        }
+
+        if (r->type == REDIR_BOTH && dup2(src, STDERR_FILENO) < 0) {
+            close(src);
+            print_error();
+            return -1;
+        }
+
+        if (move_to(src, r->fd) != 0) {
+            print_error();
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Undo in-process redirections recorded by apply_redirections() */
+void restore_redirections(redir_save_t *save)
+{
+    for (int i = save->count - 1; i >= 0; i--) {
+        if (save->saved[i] >= 0) {
+            dup2(save->saved[i], save->fds[i]);
+            close(save->saved[i]);
+        } else {
+            close(save->fds[i]);
+        }
+    }
+    save->count = 0;
+}
+
+/* Built-in: exec [command [args...]]. Its redirections are applied to
+ * the shell for good: after `exec 3>>log`, `cmd >&3` costs a dup2()
+ * instead of an open() and close() per command. With a command, the
+ * shell is then replaced by it */
+int builtin_exec(command_t *cmd, shell_state_t *state)
+{
+    for (redirect_t *r = cmd->redirs; r != NULL; r = r->next) {
+        if (r->fd >= USER_FD_LIMIT) {
+            fprintf(stderr, "exec: %d: descriptors from %d up belong to the shell\n",
+                r->fd, USER_FD_LIMIT);
+            return 1;
+        }
+    }
+
+    fflush(state->out);
+    if (apply_redirections(cmd->redirs, NULL) != 0) {
+        return 1;
+    }
+
+    /* Children must inherit the fds opened here, so they stay off the
+     * zygote until closed again */
+    for (redirect_t *r = cmd->redirs; r != NULL; r = r->next) {
+        if (r->fd <= STDERR_FILENO) continue;
+        if (r->type == REDIR_DUP && r->target_fd < 0) {
+            state->exec_fds &= ~(1u << r->fd);
+        } else {
+            state->exec_fds |= 1u << r->fd;
+        }
+    }
+    if (cmd->args[1] == NULL) {
+        return 0;
+    }
+
+    /* A command that is not found leaves the shell as it was */
+    char *cmd_path = find_command_in_path(cmd->args[1], state);
+    if (cmd_path == NULL) {
+        fprintf(stderr, "exec: %s: command not found\n", cmd->args[1]);
+        return 127;
+    }
+    free(cmd_path);
+
+    /* Nothing runs after it, so do what exit would: forward what
+     * background jobs still write and make the journal durable */
+    outmux_stop(state);
+    journal_close(state);
+
+    command_t sub;
+    memset(&sub, 0, sizeof(sub));
+    sub.args = cmd->args + 1;
+    sub.next_op = OP_NONE;
+    int status = exec_in_place(&sub, state);
+    if (status < 0) {
+        fprintf(stderr, "exec: %s: command not found\n", cmd->args[1]);
+        return 127;
+    }
+    return status;
+}
+
+/* Free a redirection list */
+void free_redirections(redirect_t *redirs)
+{
+    while (redirs != NULL) {
+        redirect_t *next = redirs->next;
+        free(redirs->target);
+        free(redirs->body);
+        free(redirs);
+        redirs = next;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,170 @@
+/* src/server.c - Persistent command server over a Unix socket */
+
+#include "../include/shell.h"
+#include "../include/server.h"
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+extern char **environ;
+
+/* Receive one request and the client's stdio descriptors */
+static ssize_t receive_request(int conn, char *buf, size_t size, int fds[SERVER_FD_COUNT])
+{
+    char control[CMSG_SPACE(sizeof(int) * SERVER_FD_COUNT)];
+    struct iovec iov = { buf, size - 1 };
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t len = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    if (len <= 0) return -1;
+    buf[len] = '\0';
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(int) * SERVER_FD_COUNT)) {
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * SERVER_FD_COUNT);
+
+    /* Cut short: the descriptors are there to report it through */
+    if (msg.msg_flags & MSG_TRUNC) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    return len;
+}
+
+/* Worker: run one request in a copy of the warm shell and exit */
+static void serve_request(int conn, shell_state_t *state)
+{
+    static char request[SERVER_MAX_REQUEST];
+    int fds[SERVER_FD_COUNT];
+    int32_t status = 1;
+
+    ssize_t len = receive_request(conn, request, sizeof(request), fds);
+    if (len < 0 && errno != EMSGSIZE) _exit(1);
+
+    /* Client's stdio becomes ours */
+    for (int i = 0; i < SERVER_FD_COUNT; i++) {
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+
+    /* Never run a request with part of its environment missing */
+    if (len < 0) {
+        fprintf(stderr, "request too large (over %d bytes)\n", SERVER_MAX_REQUEST);
+        if (write(conn, &status, sizeof(status)) < 0) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+
+    /* Payload: cwd, command line, environment */
+    char *cwd = request;
+    char *line = cwd + strlen(cwd) + 1;
+    char *end = request + len;
+    if (line >= end) _exit(1);
+
+    clearenv();
+    for (char *env = line + strlen(line) + 1; env < end; env += strlen(env) + 1) {
+        if (strchr(env, '=') != NULL) putenv(env);
+    }
+
+    /* Fresh per-request view of the directories */
+    if (chdir(cwd) == 0) {
+        free(state->cwd);
+        state->cwd = my_strdup(cwd);
+        free(state->oldpwd);
+        state->oldpwd = my_strdup(cwd);
+    }
+    state->shell_pid = getpid();
+    state->exit_requested = 0;
+
+    command_t *cmd = parse_command(line, state);
+    if (cmd != NULL) {
+        execute_command(cmd, state);
+        free_command(cmd);
+    }
+    fflush(stdout);
+
+    status = state->exit_requested ? state->exit_status : state->last_exit_status;
+    if (write(conn, &status, sizeof(status)) < 0) {
+        _exit(1);
+    }
+    _exit(0);
+}
+
+/* Accept requests forever, forking each from the warm shell state */
+void run_server(shell_state_t *state)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(state->server_path) >= sizeof(addr.sun_path)) {
+        print_error();
+        state->exit_status = 1;
+        return;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        print_error();
+        state->exit_status = 1;
+        return;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, state->server_path);
+    unlink(state->server_path);
+
+    /* Only the owner may connect */
+    mode_t old_mask = umask(077);
+    int bound = bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+
+    if (bound != 0 || listen(sock, SOMAXCONN) != 0) {
+        print_error();
+        close(sock);
+        state->exit_status = 1;
+        return;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    for (;;) {
+        int conn = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+
+        /* Reap finished workers */
+        while (waitpid(-1, NULL, WNOHANG) > 0) {
+            /* nothing */
+        }
+
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            print_error();
+            break;
+        }
+
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(sock);
+            signal(SIGPIPE, SIG_DFL);
+            serve_request(conn, state);
+        }
+        if (pid < 0) {
+            print_error();
+        }
+        close(conn);
+    }
+
+    close(sock);
+    unlink(state->server_path);
+    state->exit_status = 1;
+}
\ No newline at end of file
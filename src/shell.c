@@ -1,16 +1,89 @@
 #include "../include/shell.h"
+#include <getopt.h>
 
 /* External environment */
 extern char **environ;
 
+static char *read_line(shell_state_t *state, const char *prompt);
+
 /* Initialize shell state */
 void init_shell(shell_state_t *state, int argc, char **argv)
 {
     /* Clear the structure */
     memset(state, 0, sizeof(shell_state_t));
     
+    /* Options */
+    static const struct option options[] = {
+        { "pipeline", no_argument, NULL, 'P' },
+        { "server", required_argument, NULL, 'S' },
+        { "zygote", no_argument, NULL, 'z' },
+        { "command", required_argument, NULL, 'c' },
+        { "journal", required_argument, NULL, 'J' },
+        { "resume", no_argument, NULL, 'R' },
+        { "jobs", required_argument, NULL, 'j' },
+        { "prescan", no_argument, NULL, 'p' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+    int use_zygote = 0;
+    char *journal_path = NULL;
+    int resume = 0;
+    int prescan = 0;
+    while ((opt = getopt_long(argc, argv, "+Pzc:j:", options, NULL)) != -1) {
+        switch (opt) {
+            case 'P':
+                state->pipelined = 1;
+                break;
+            case 'S':
+                state->server_path = my_strdup(optarg);
+                break;
+            case 'z':
+                use_zygote = 1;
+                break;
+            case 'c':
+                free(state->command_string);
+                state->command_string = my_strdup(optarg);
+                break;
+            case 'J':
+                journal_path = optarg;
+                break;
+            case 'R':
+                resume = 1;
+                break;
+            case 'p':
+                prescan = 1;
+                break;
+            case 'j':
+                state->dag_jobs = atoi(optarg);
+                if (state->dag_jobs < 1) {
+                    fprintf(stderr, "-j needs a positive worker count\n");
+                    exit(1);
+                }
+                break;
+            default:
+                print_error();
+                exit(1);
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+    
+    /* Fork the spawn helper first, while this process is smallest */
+    if (use_zygote && zygote_start(state) != 0) {
+        print_error();
+    }
+    
     /* Determine shell mode */
-    if (argc == 1) {
+    if (state->command_string != NULL) {
+        /* -c: the string is the script; later operands are ignored */
+        state->mode = MODE_BATCH;
+        state->batch_fp = fmemopen(state->command_string,
+            strlen(state->command_string), "r");
+        if (state->batch_fp == NULL) {
+            print_error();
+            exit(1);
+        }
+    } else if (argc == 1) {
         /* No arguments - check if interactive */
         if (isatty(STDIN_FILENO)) {
             state->mode = MODE_INTERACTIVE;
@@ -27,7 +100,8 @@ void init_shell(shell_state_t *state, int argc, char **argv)
         }
         
         /* Open batch file */
-        state->batch_fp = fopen(state->batch_file, "r");
+        int fd = move_fd_high(open(state->batch_file, O_RDONLY | O_CLOEXEC));
+        state->batch_fp = fd >= 0 ? fdopen(fd, "r") : NULL;
         if (state->batch_fp == NULL) {
             print_error();
             exit(1);
@@ -38,6 +112,23 @@ void init_shell(shell_state_t *state, int argc, char **argv)
         exit(1);
     }
     
+    /* Journal a script's lines (--resume needs a journal) */
+    if (resume && journal_path == NULL) {
+        fprintf(stderr, "--resume requires --journal FILE\n");
+        exit(1);
+    }
+    if (journal_path != NULL && state->mode == MODE_BATCH &&
+        journal_open(state, journal_path, resume) != 0) {
+        print_error();
+        exit(1);
+    }
+    
+    /* Builtins write to stdout unless capturing */
+    state->out = stdout;
+    
+    /* Nothing is pinned unless a background job asks for it */
+    state->spawn_cpu = -1;
+    
     /* Initialize shell PID */
     state->shell_pid = getpid();
     
@@ -61,24 +152,149 @@ void init_shell(shell_state_t *state, int argc, char **argv)
     /* Initialize path */
     init_path(state);
     
+    /* Look up the script's commands before running it */
+    if (prescan) {
+        prescan_script(state);
+    }
+    
     /* Set default exit status */
     state->exit_status = 0;
     state->last_exit_status = 0;
     state->exit_requested = 0;
 }
 
+/* Status to journal for a line; one that failed to parse failed */
+static int line_status(shell_state_t *state, int parsed)
+{
+    if (!parsed) return 1;
+    return state->exit_requested ? state->exit_status : state->last_exit_status;
+}
+
+/* Consume the here-document bodies of a line that is not run */
+static void skip_heredocs(shell_state_t *state, const char *text)
+{
+    int count;
+    char **delims = scan_heredoc_delimiters((char *)text, &count);
+    
+    for (int i = 0; i < count; i++) {
+        char *line;
+        while ((line = read_line(state, HEREDOC_PROMPT)) != NULL) {
+            int end = strcmp(line, delims[i]) == 0;
+            free(line);
+            if (end) break;
+        }
+    }
+    free_string_array(delims);
+}
+
+/* Continuation lines of a loop, with the secondary prompt */
+static char *read_loop_line(void *state)
+{
+    return read_line(state, HEREDOC_PROMPT);
+}
+
+/* Execute a line from the read-ahead thread; lines it could not parse
+ * safely are parsed now, after every earlier line has run */
+static void run_input_line(input_line_t *line, shell_state_t *state)
+{
+    command_t *cmd = line->cmd;
+    line->cmd = NULL;
+    if (cmd != NULL) {
+        metrics_add_parse(state, line->parse_ns);
+    }
+    
+    if (cmd == NULL && starts_loop(line->text)) {
+        run_loop(line->text, state);
+        journal_record(state, line->lineno, line->text, line_status(state, 1));
+        return;
+    }
+    if (cmd == NULL) {
+        cmd = parse_command(line->text, state);
+    }
+    
+    /* Here-document bodies come from the lines read ahead */
+    state->pending_lines = line->heredoc_lines;
+    state->pending_count = line->heredoc_count;
+    state->pending_next = 0;
+    
+    if (cmd != NULL) {
+        collect_heredocs(cmd, state);
+        execute_command(cmd, state);
+        free_command(cmd);
+    }
+    journal_record(state, line->lineno, line->text, line_status(state, cmd != NULL));
+    
+    state->pending_lines = NULL;
+    state->pending_count = 0;
+}
+
+/* Has the script been read to the end? Only a batch file or -c
+ * string can tell without blocking on a user */
+static int at_end_of_input(shell_state_t *state)
+{
+    if (state->mode != MODE_BATCH) return 0;
+    if (state->pipelined) return pipeline_at_end(state);
+    
+    int c = getc(state->batch_fp);
+    if (c == EOF) return 1;
+    ungetc(c, state->batch_fp);
+    return 0;
+}
+
+/* May the last command replace the shell? Not while a journal still
+ * has to record how it ended */
+static int may_exec_tail(shell_state_t *state)
+{
+    return state->journal == NULL && at_end_of_input(state);
+}
+
 /* Main shell loop */
 void run_shell(shell_state_t *state)
 {
     char *input = NULL;
     command_t *cmd = NULL;
     
+    /* Command server: serve requests instead of reading input */
+    if (state->server_path != NULL) {
+        run_server(state);
+        return;
+    }
+    
     if (state->mode == MODE_INTERACTIVE) {
         setup_signals();
     }
     
+    /* Annotated scripts run as a dependency graph */
+    if (state->dag_jobs > 0 && state->mode == MODE_BATCH) {
+        run_dag(state);
+        return;
+    }
+    
+    /* Read-ahead only pays off (and is only safe) on a batch file */
+    if (state->pipelined &&
+        (state->mode != MODE_BATCH || pipeline_start(state) != 0)) {
+        state->pipelined = 0;
+    }
+    
     while (!state->exit_requested) {
+        jobs_reap(state);
+        metrics_tick(state);
+        
+        if (state->pipelined) {
+            input_line_t *line = pipeline_next(state);
+            if (line == NULL) {
+                break;
+            }
+            if (!journal_skip(state, line->lineno, line->text)) {
+                state->exec_tail = may_exec_tail(state);
+                run_input_line(line, state);
+            }
+            free_input_line(line);
+            continue;
+        }
+        
         input = read_input(state);
+        int lineno = state->lineno;
         if (input == NULL) {
             if (state->mode == MODE_INTERACTIVE) {
                 printf("\n");
@@ -91,27 +307,74 @@ void run_shell(shell_state_t *state)
             continue;
         }
         
+        /* A loop runs once all of its lines are in */
+        if (loop_depth(input) > 0) {
+            input = join_loop_lines(input, read_loop_line, state);
+        }
+        
+        /* Completed in the run being resumed */
+        if (journal_skip(state, lineno, input)) {
+            skip_heredocs(state, input);
+            free(input);
+            continue;
+        }
+        
+        if (starts_loop(input)) {
+            state->exec_tail = 0;
+            run_loop(input, state);
+            journal_record(state, lineno, input, line_status(state, 1));
+            free(input);
+            continue;
+        }
+        
         cmd = parse_command(input, state);
         if (cmd == NULL) {
+            journal_record(state, lineno, input, line_status(state, 0));
             free(input);
             continue;
         }
         
+        collect_heredocs(cmd, state);
+        state->exec_tail = may_exec_tail(state);
         execute_command(cmd, state);
+        journal_record(state, lineno, input, line_status(state, 1));
         free_command(cmd);
         free(input);
     }
+    
+    /* A script exits with the status of its last command */
+    if (state->mode == MODE_BATCH && !state->exit_requested) {
+        state->exit_status = state->last_exit_status;
+    }
+    
+    if (state->pipelined) {
+        pipeline_stop(state);
+    }
 }
 
-/* Read input based on mode */
-char *read_input(shell_state_t *state)
+/* Read one line, prompting in interactive mode */
+static char *read_line(shell_state_t *state, const char *prompt)
 {
     char buffer[MAX_INPUT];
     char *input = NULL;
     
+    /* Lines read ahead are served first and stand in for the input */
+    if (state->pending_lines != NULL) {
+        if (state->pending_next >= state->pending_count) {
+            return NULL;
+        }
+        return my_strdup(state->pending_lines[state->pending_next++]);
+    }
+    
+    /* At a terminal, lines are read with editing and completion */
+    if (state->mode == MODE_INTERACTIVE && state->batch_fp == NULL &&
+        isatty(STDIN_FILENO) && isatty(STDOUT_FILENO)) {
+        return edit_line(state, prompt);
+    }
+    
     /* Print prompt for interactive mode */
     if (state->mode == MODE_INTERACTIVE) {
-        printf(PROMPT);
+        printf("%s", prompt);
         fflush(stdout);
     }
     
@@ -121,6 +384,7 @@ char *read_input(shell_state_t *state)
         if (fgets(buffer, MAX_INPUT, state->batch_fp) == NULL) {
             return NULL;
         }
+        state->lineno++;
     } else {
         /* Read from stdin */
         if (fgets(buffer, MAX_INPUT, stdin) == NULL) {
@@ -139,6 +403,51 @@ char *read_input(shell_state_t *state)
     return input;
 }
 
+/* Read input based on mode */
+char *read_input(shell_state_t *state)
+{
+    return read_line(state, PROMPT);
+}
+
+/* Read here-document bodies that follow the command line */
+void collect_heredocs(command_t *cmd, shell_state_t *state)
+{
+    for (command_t *current = cmd; current != NULL; current = current->next) {
+        for (redirect_t *r = current->redirs; r != NULL; r = r->next) {
+            if (r->type != REDIR_HEREDOC || r->body != NULL) {
+                continue;
+            }
+            
+            buffer_t body;
+            buf_init(&body);
+            for (;;) {
+                char *line = read_line(state, HEREDOC_PROMPT);
+                if (line == NULL) {
+                    break; /* End of input also ends the document */
+                }
+                if (strcmp(line, r->target) == 0) {
+                    free(line);
+                    break;
+                }
+                buf_append(&body, line, strlen(line));
+                buf_append(&body, "\n", 1);
+                free(line);
+            }
+            
+            r->body = buf_release(&body);
+            
+            /* Unquoted delimiter: expand variables in the body */
+            if (!r->quoted) {
+                char *expanded = expand_variables(r->body, state);
+                if (expanded) {
+                    free(r->body);
+                    r->body = expanded;
+                }
+            }
+        }
+    }
+}
+
 /* Cleanup shell resources */
 void cleanup_shell(shell_state_t *state)
 {
@@ -147,6 +456,8 @@ void cleanup_shell(shell_state_t *state)
     if (state->home != NULL) free(state->home);
     if (state->oldpwd != NULL) free(state->oldpwd);
     if (state->batch_file != NULL) free(state->batch_file);
+    if (state->server_path != NULL) free(state->server_path);
+    if (state->command_string != NULL) free(state->command_string);
     
     /* Free path directories */
     if (state->path_dirs != NULL) {
@@ -156,6 +467,27 @@ void cleanup_shell(shell_state_t *state)
         free(state->path_dirs);
     }
     
+    /* Last word for the metrics collector */
+    metrics_write(state);
+    
+    /* Make the journal durable */
+    journal_close(state);
+    
+    /* Forward what background jobs still write */
+    outmux_stop(state);
+    
+    /* Free shell variables and forget children */
+    free_shell_vars(state);
+    free_read_buffers(state);
+    complete_free(state);
+    history_free(state);
+    free_plugins();
+    prescan_free(state);
+    coproc_stop(state);
+    source_free(state);
+    free_jobs(state);
+    zygote_stop(state);
+    
     /* Close batch file */
     if (state->batch_fp != NULL) {
         fclose(state->batch_fp);
@@ -0,0 +1,308 @@
+/* src/source.c - source/. builtin with a cache of parsed scripts
+ *
+ *     source FILE     (or: . FILE)
+ *
+ * Runs FILE's lines in the current shell, so its variables, cd, path
+ * and aliases stay in effect. A file is read, split into lines (loops
+ * joined, here-document bodies attached) and its state-independent
+ * lines parsed once; the result is kept, keyed by the file's resolved
+ * path, and reused while the path still names the same inode with the
+ * same mtime and size. Sourcing a shared library script many times
+ * then costs neither reading nor parsing it again.
+ *
+ * As in pipelined mode (pipeline.c), only lines that cannot depend on
+ * shell state are kept parsed: lines with variables or substitutions,
+ * loops and lines with here-documents or process substitutions (which
+ * execution fills in) are kept as text and parsed when they run.
+ */
+
+#include "../include/shell.h"
+
+#define SOURCE_CACHE_MAX 64         /* Files kept parsed */
+#define SOURCE_MAX_DEPTH 64         /* Nested source calls */
+
+typedef struct source_file_s {
+    char *path;                     /* Resolved path */
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    off_t size;
+    input_line_t *lines;
+    int count;
+    int users;                      /* source calls running it */
+    int stale;                      /* Dropped from the cache while in use */
+    struct source_file_s *next;
+} source_file_t;
+
+struct source_cache_s {
+    source_file_t *files;           /* Most recently used first */
+    int count;
+    int depth;                      /* Nesting of running source calls */
+};
+
+static char *empty_heredoc[] = { NULL };
+
+/* read_script_line() for join_loop_lines() and read_heredoc_lines() */
+static char *read_file_line(void *fp)
+{
+    return read_script_line(fp);
+}
+
+/* Does running cmd write into it (here-document bodies, /dev/fd paths
+ * of process substitutions)? Then it cannot be reused */
+static int filled_at_run(command_t *cmd)
+{
+    for (; cmd != NULL; cmd = cmd->next) {
+        if (cmd->procsubs != NULL) return 1;
+        for (redirect_t *r = cmd->redirs; r != NULL; r = r->next) {
+            if (r->type == REDIR_HEREDOC) return 1;
+        }
+    }
+    return 0;
+}
+
+/* Read and split a file, parsing what can be parsed ahead */
+static int load_lines(shell_state_t *state, FILE *fp, source_file_t *file)
+{
+    int capacity = 0;
+    int lineno = 0;
+    char *text;
+
+    /* Errors in ahead-of-time parses are reported when the line runs */
+    set_errors_quiet(1);
+    while ((text = read_file_line(fp)) != NULL) {
+        lineno++;
+        if (text[0] == '\0' || text[0] == '#') {
+            free(text);
+            continue;
+        }
+        if (file->count >= capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            input_line_t *grown = realloc(file->lines, capacity * sizeof(input_line_t));
+            if (grown == NULL) {
+                free(text);
+                set_errors_quiet(0);
+                return -1;
+            }
+            file->lines = grown;
+        }
+
+        input_line_t *line = &file->lines[file->count++];
+        memset(line, 0, sizeof(input_line_t));
+        line->lineno = lineno;
+        if (loop_depth(text) > 0) {
+            text = join_loop_lines(text, read_file_line, fp);
+        }
+        line->text = text;
+        if (starts_loop(text)) continue;
+
+        read_heredoc_lines(line, read_file_line, fp);
+        if (line->heredoc_count == 0 && parse_is_static(text)) {
+            line->cmd = parse_command(text, state);
+            if (filled_at_run(line->cmd)) {
+                free_command(line->cmd);
+                line->cmd = NULL;
+            }
+        }
+    }
+    set_errors_quiet(0);
+    return 0;
+}
+
+/* Free a file's lines, now or when its last user is done */
+static void release_file(source_file_t *file)
+{
+    if (file->users > 0) {
+        file->stale = 1;
+        return;
+    }
+    for (int i = 0; i < file->count; i++) {
+        free(file->lines[i].text);
+        free_command(file->lines[i].cmd);
+        for (int j = 0; j < file->lines[i].heredoc_count; j++) {
+            free(file->lines[i].heredoc_lines[j]);
+        }
+        free(file->lines[i].heredoc_lines);
+    }
+    free(file->lines);
+    free(file->path);
+    free(file);
+}
+
+/* Unlink a cached file from the list */
+static void unlink_file(struct source_cache_s *cache, source_file_t *file)
+{
+    for (source_file_t **link = &cache->files; *link != NULL; link = &(*link)->next) {
+        if (*link == file) {
+            *link = file->next;
+            cache->count--;
+            break;
+        }
+    }
+}
+
+/* Remove a file from the cache */
+static void drop_file(struct source_cache_s *cache, source_file_t *file)
+{
+    unlink_file(cache, file);
+    release_file(file);
+}
+
+/* The cached lines of path, read afresh if the file changed */
+static source_file_t *lookup_file(shell_state_t *state, const char *name)
+{
+    struct source_cache_s *cache = state->source_cache;
+    char *path = realpath(name, NULL);
+    struct stat st;
+
+    if (path == NULL || stat(path, &st) != 0) {
+        fprintf(stderr, "source: %s: %s\n", name, strerror(errno));
+        free(path);
+        return NULL;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "source: %s: Is a directory\n", name);
+        free(path);
+        return NULL;
+    }
+
+    for (source_file_t *file = cache->files; file != NULL; file = file->next) {
+        if (strcmp(file->path, path) != 0) continue;
+        if (file->dev == st.st_dev && file->ino == st.st_ino && file->size == st.st_size &&
+            file->mtime.tv_sec == st.st_mtim.tv_sec &&
+            file->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            /* Move to the front */
+            unlink_file(cache, file);
+            file->next = cache->files;
+            cache->files = file;
+            cache->count++;
+            free(path);
+            return file;
+        }
+        drop_file(cache, file);
+        break;
+    }
+
+    FILE *fp = fopen(path, "re");
+    source_file_t *file = calloc(1, sizeof(source_file_t));
+    if (fp == NULL || file == NULL) {
+        fprintf(stderr, "source: %s: %s\n", name, strerror(errno));
+        if (fp != NULL) fclose(fp);
+        free(file);
+        free(path);
+        return NULL;
+    }
+
+    /* What was opened is what gets cached */
+    fstat(fileno(fp), &st);
+    file->path = path;
+    file->dev = st.st_dev;
+    file->ino = st.st_ino;
+    file->mtime = st.st_mtim;
+    file->size = st.st_size;
+    int loaded = load_lines(state, fp, file);
+    fclose(fp);
+    if (loaded != 0) {
+        print_error();
+        release_file(file);
+        return NULL;
+    }
+
+    /* Make room: the least recently used file goes */
+    while (cache->count >= SOURCE_CACHE_MAX) {
+        source_file_t *last = cache->files;
+        while (last->next != NULL) last = last->next;
+        drop_file(cache, last);
+    }
+    file->next = cache->files;
+    cache->files = file;
+    cache->count++;
+    return file;
+}
+
+/* Run one line of a sourced file */
+static void run_source_line(input_line_t *line, shell_state_t *state)
+{
+    if (line->cmd != NULL) {
+        execute_command(line->cmd, state);
+        return;
+    }
+    if (starts_loop(line->text)) {
+        run_loop(line->text, state);
+        return;
+    }
+
+    command_t *cmd = parse_command(line->text, state);
+    if (cmd == NULL) {
+        state->last_exit_status = 1;
+        return;
+    }
+
+    /* Here-document bodies come from the file, never from our input */
+    state->pending_lines = line->heredoc_lines ? line->heredoc_lines : empty_heredoc;
+    state->pending_count = line->heredoc_count;
+    state->pending_next = 0;
+    collect_heredocs(cmd, state);
+    execute_command(cmd, state);
+    free_command(cmd);
+}
+
+/* Built-in: source FILE / . FILE */
+int builtin_source(command_t *cmd, shell_state_t *state)
+{
+    if (cmd->args[1] == NULL) {
+        fprintf(stderr, "%s: usage: %s FILE\n", cmd->args[0], cmd->args[0]);
+        return 2;
+    }
+    if (state->source_cache == NULL) {
+        state->source_cache = calloc(1, sizeof(struct source_cache_s));
+        if (state->source_cache == NULL) {
+            print_error();
+            return 1;
+        }
+    }
+    struct source_cache_s *cache = state->source_cache;
+    if (cache->depth >= SOURCE_MAX_DEPTH) {
+        fprintf(stderr, "source: %s: nested too deeply\n", cmd->args[1]);
+        return 1;
+    }
+
+    source_file_t *file = lookup_file(state, cmd->args[1]);
+    if (file == NULL) return 1;
+
+    /* The sourced lines run to completion and return here */
+    int exec_tail = state->exec_tail;
+    char **pending_lines = state->pending_lines;
+    int pending_count = state->pending_count;
+    int pending_next = state->pending_next;
+    state->exec_tail = 0;
+    state->last_exit_status = 0;
+
+    file->users++;
+    cache->depth++;
+    for (int i = 0; i < file->count && !state->exit_requested; i++) {
+        run_source_line(&file->lines[i], state);
+    }
+    cache->depth--;
+    file->users--;
+    if (file->stale) release_file(file);
+
+    state->exec_tail = exec_tail;
+    state->pending_lines = pending_lines;
+    state->pending_count = pending_count;
+    state->pending_next = pending_next;
+    return state->last_exit_status;
+}
+
+/* Drop every cached file */
+void source_free(shell_state_t *state)
+{
+    struct source_cache_s *cache = state->source_cache;
+    if (cache == NULL) return;
+
+    while (cache->files != NULL) {
+        drop_file(cache, cache->files);
+    }
+    free(cache);
+    state->source_cache = NULL;
+}
\ No newline at end of file
@@ -0,0 +1,167 @@
+/* src/subst.c - Command substitution: $(...) and `...` */
+
+#include "../include/shell.h"
+
+/* Read size for external substitutions */
+#define SUBST_READ_CHUNK 65536
+
+/* Skip over a $(...) or `...` (or the <(...) / >(...) of a process
+ * substitution) starting at pos; returns the character after the
+ * closing delimiter, or NULL if it is unterminated */
+char *skip_substitution(char *pos)
+{
+    if (pos[0] == '`') {
+        char *end = strchr(pos + 1, '`');
+        return end ? end + 1 : NULL;
+    }
+
+    /* X( ... ) with nesting and quotes */
+    int depth = 1;
+    char quote = 0;
+    pos += 2;
+    while (*pos) {
+        if (quote) {
+            if (*pos == quote) quote = 0;
+        } else if (*pos == '\'' || *pos == '"') {
+            quote = *pos;
+        } else if (*pos == '(') {
+            depth++;
+        } else if (*pos == ')') {
+            if (--depth == 0) return pos + 1;
+        }
+        pos++;
+    }
+    return NULL;
+}
+
+/* Builtins that only produce output and never touch shell state */
+static int is_pure_builtin(char *name)
+{
+    return (strcmp(name, "echo") == 0 || strcmp(name, "pwd") == 0 ||
+        strcmp(name, "env") == 0);
+}
+
+/* Can the whole chain run in-process with its output captured? */
+static int chain_is_pure(command_t *cmd)
+{
+    for (command_t *c = cmd; c != NULL; c = c->next) {
+        if (c->args[0] == NULL || !is_pure_builtin(c->args[0])) return 0;
+        if (c->background || c->redirs != NULL) return 0;
+    }
+    return 1;
+}
+
+/* Run builtins with state->out pointed at an in-memory stream */
+static char *capture_builtin(command_t *cmd, shell_state_t *state)
+{
+    char *data = NULL;
+    size_t len = 0;
+    FILE *mem = open_memstream(&data, &len);
+    if (mem == NULL) {
+        print_error();
+        return NULL;
+    }
+
+    FILE *saved = state->out;
+    state->out = mem;
+    execute_command(cmd, state);
+    state->out = saved;
+
+    fclose(mem);
+    return data;
+}
+
+/* Run the chain in a child and collect its stdout through a pipe */
+static char *capture_external(command_t *cmd, shell_state_t *state)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        print_error();
+        return NULL;
+    }
+
+    fflush(stdout);
+    fflush(state->out);
+
+    pid_t pid = fork();
+    if (pid > 0) state->metrics.forks++;
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        print_error();
+        return NULL;
+    }
+
+    if (pid == 0) {
+        /* Child: run the chain with stdout on the pipe */
+        close(fds[0]);
+        if (dup2(fds[1], STDOUT_FILENO) < 0) {
+            _exit(1);
+        }
+        close(fds[1]);
+        state->exec_tail = 1;
+        execute_command(cmd, state);
+        fflush(stdout);
+        _exit(state->last_exit_status);
+    }
+
+    /* Parent: read straight into the spare capacity of one buffer,
+     * growing it geometrically rather than per chunk */
+    close(fds[1]);
+    buffer_t out;
+    buf_init(&out);
+    for (;;) {
+        if (buf_reserve(&out, SUBST_READ_CHUNK) != 0) {
+            print_error();
+            break;
+        }
+        ssize_t n = read(fds[0], out.data + out.len, out.cap - out.len - 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        out.len += n;
+    }
+    if (out.data != NULL) out.data[out.len] = '\0';
+    close(fds[0]);
+
+    int status;
+    while (wait_child(state, pid, &status, 0) < 0 && errno == EINTR) {
+        /* retry */
+    }
+    state->last_exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+
+    return buf_release(&out);
+}
+
+/* Execute `text` and return its output minus trailing newlines */
+char *command_substitute(const char *text, shell_state_t *state)
+{
+    char *script = my_strdup(text);
+    if (script == NULL) {
+        print_error();
+        return NULL;
+    }
+
+    command_t *cmd = parse_command(script, state);
+    free(script);
+    if (cmd == NULL) {
+        return my_strdup("");
+    }
+
+    char *result;
+    if (chain_is_pure(cmd)) {
+        result = capture_builtin(cmd, state);
+    } else {
+        result = capture_external(cmd, state);
+    }
+    free_command(cmd);
+
+    if (result == NULL) {
+        return my_strdup("");
+    }
+
+    size_t len = strlen(result);
+    while (len > 0 && result[len - 1] == '\n') {
+        result[--len] = '\0';
+    }
+    return result;
+}
\ No newline at end of file
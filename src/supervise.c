@@ -0,0 +1,217 @@
+/* src/supervise.c - timeout and retry builtins
+ *
+ * The command runs as an ordinary child of the shell (or of the zygote);
+ * a pidfd for it and a timerfd for the deadline share one epoll set, so
+ * the shell sleeps until whichever comes first without a helper process.
+ */
+
+#include "../include/shell.h"
+#include <sys/epoll.h>
+#include <sys/pidfd.h>
+#include <sys/timerfd.h>
+
+/* Grace period between SIGTERM and SIGKILL unless -k says otherwise */
+#define TIMEOUT_DEFAULT_KILL_MS 5000
+
+/* Exit status of a command that ran out of time (as coreutils) */
+#define TIMEOUT_STATUS 124
+
+/* First delay for retry --backoff, doubled per attempt up to the cap */
+#define RETRY_BACKOFF_MS 100
+#define RETRY_BACKOFF_MAX_MS 30000
+
+/* Parse "1.5", "30s", "2m", "1h" or "1d" into milliseconds; -1 if bad */
+static long parse_duration(const char *text)
+{
+    char *end;
+    double value = strtod(text, &end);
+
+    if (end == text || !(value >= 0)) return -1;
+
+    switch (*end) {
+        case '\0':
+        case 's':
+            break;
+        case 'm':
+            value *= 60;
+            break;
+        case 'h':
+            value *= 60 * 60;
+            break;
+        case 'd':
+            value *= 24 * 60 * 60;
+            break;
+        default:
+            return -1;
+    }
+    if (*end != '\0' && end[1] != '\0') return -1;
+
+    return (long)(value * 1000);
+}
+
+/* Arm a one-shot timer ms from now */
+static int arm_timer(int tfd, long ms)
+{
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = ms / 1000;
+    spec.it_value.tv_nsec = (ms % 1000) * 1000000;
+    if (ms == 0) spec.it_value.tv_nsec = 1; /* Zero would disarm */
+    return timerfd_settime(tfd, 0, &spec, NULL);
+}
+
+/* Wait for pid, sending SIGTERM after timeout_ms and SIGKILL kill_ms
+ * later; returns the shell status (124 or 137 if it had to be stopped) */
+static int supervise(shell_state_t *state, pid_t pid, long timeout_ms, long kill_ms)
+{
+    int status;
+    int signalled = 0;
+
+    int pidfd = (int)pidfd_open(pid, 0);
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (pidfd >= 0 && tfd >= 0 && epfd >= 0 && arm_timer(tfd, timeout_ms) == 0) {
+        struct epoll_event ev = { EPOLLIN, { .fd = pidfd } };
+        epoll_ctl(epfd, EPOLL_CTL_ADD, pidfd, &ev);
+        ev.data.fd = tfd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+
+        for (;;) {
+            struct epoll_event event;
+            int n = epoll_wait(epfd, &event, 1, -1);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (event.data.fd == pidfd) {
+                break; /* Exited; reaped below */
+            }
+
+            uint64_t expirations;
+            if (read(tfd, &expirations, sizeof(expirations)) < 0) {
+                /* Spurious wakeup */
+                continue;
+            }
+            if (signalled == 0) {
+                pidfd_send_signal(pidfd, SIGTERM, NULL, 0);
+                signalled = SIGTERM;
+                arm_timer(tfd, kill_ms);
+            } else if (signalled == SIGTERM) {
+                pidfd_send_signal(pidfd, SIGKILL, NULL, 0);
+                signalled = SIGKILL;
+            }
+        }
+    } else if (pidfd < 0 && errno != ESRCH) {
+        /* No pidfd support: run without a deadline */
+        print_error();
+    }
+
+    if (pidfd >= 0) close(pidfd);
+    if (tfd >= 0) close(tfd);
+    if (epfd >= 0) close(epfd);
+
+    while (wait_child(state, pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return 1;
+        }
+    }
+
+    if (signalled == SIGKILL) return 128 + SIGKILL;
+    if (signalled == SIGTERM) return TIMEOUT_STATUS;
+    return exit_code(status);
+}
+
+/* The command wrapped by a builtin, sharing cmd's argument strings;
+ * redirections were already applied to the shell by execute_builtin */
+static command_t wrapped_command(command_t *cmd, int first)
+{
+    command_t sub;
+
+    memset(&sub, 0, sizeof(sub));
+    sub.args = cmd->args + first;
+    sub.next_op = OP_NONE;
+    return sub;
+}
+
+/* Built-in: timeout [-k KILL_AFTER] DURATION command [args...] */
+int builtin_timeout(command_t *cmd, shell_state_t *state)
+{
+    long kill_ms = TIMEOUT_DEFAULT_KILL_MS;
+    int i = 1;
+
+    if (cmd->args[i] != NULL && strcmp(cmd->args[i], "-k") == 0) {
+        i++;
+        kill_ms = cmd->args[i] ? parse_duration(cmd->args[i++]) : -1;
+    }
+    long timeout_ms = cmd->args[i] ? parse_duration(cmd->args[i]) : -1;
+    if (kill_ms < 0 || timeout_ms < 0 || cmd->args[i + 1] == NULL) {
+        fprintf(stderr, "timeout: usage: timeout [-k DURATION] DURATION command [args...]\n");
+        return 1;
+    }
+
+    command_t sub = wrapped_command(cmd, i + 1);
+
+    /* Builtins run in-process and cannot be interrupted */
+    if (is_builtin(sub.args[0])) {
+        return execute_builtin(&sub, state);
+    }
+
+    pid_t pid = spawn_external(&sub, state);
+    if (pid < 0) {
+        return state->last_exit_status;
+    }
+    return supervise(state, pid, timeout_ms, kill_ms);
+}
+
+/* Built-in: retry N [--backoff] command [args...] - rerun until success */
+int builtin_retry(command_t *cmd, shell_state_t *state)
+{
+    int backoff = 0;
+    int i = 2;
+    char *end;
+
+    long attempts = cmd->args[1] ? strtol(cmd->args[1], &end, 10) : 0;
+    if (cmd->args[1] == NULL || *end != '\0' || attempts < 1) {
+        attempts = 0;
+    }
+    if (attempts > 0 && cmd->args[i] != NULL && strcmp(cmd->args[i], "--backoff") == 0) {
+        backoff = 1;
+        i++;
+    }
+    if (attempts == 0 || cmd->args[i] == NULL) {
+        fprintf(stderr, "retry: usage: retry N [--backoff] command [args...]\n");
+        return 1;
+    }
+
+    command_t sub = wrapped_command(cmd, i);
+    long delay_ms = RETRY_BACKOFF_MS;
+    int result = 1;
+
+    /* Every attempt but the last must come back to the shell */
+    int exec_tail = state->exec_tail;
+    state->exec_tail = 0;
+
+    for (long attempt = 1; attempt <= attempts; attempt++) {
+        if (is_builtin(sub.args[0])) {
+            result = execute_builtin(&sub, state);
+        } else {
+            result = execute_external(&sub, state);
+        }
+        if (result == 0 || attempt == attempts || state->exit_requested) {
+            break;
+        }
+
+        if (backoff) {
+            struct timespec pause = { delay_ms / 1000, (delay_ms % 1000) * 1000000 };
+            while (nanosleep(&pause, &pause) != 0 && errno == EINTR) {
+                /* resume */
+            }
+            delay_ms = delay_ms * 2 > RETRY_BACKOFF_MAX_MS ? RETRY_BACKOFF_MAX_MS : delay_ms * 2;
+        }
+    }
+
+    state->exec_tail = exec_tail;
+    return result;
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+/* src/usage.c - Resource accounting for child processes
+ *
+ * Children are reaped with wait4(), and zygote children's usage is
+ * relayed by the zygote along with their exit status. What each child
+ * used is added to the shell's totals, which the times builtin reports.
+ * A chain prefixed with `time` reports its own share. After each
+ * foreground command, LAST_USER_MS, LAST_SYS_MS, LAST_RSS_KB and
+ * LAST_CTXSW hold what that command used; a finished background job
+ * keeps its own usage until `jobs` shows it.
+ */
+
+#include "../include/shell.h"
+#include <time.h>
+#include <sys/time.h>
+
+/* Add a reaped child's usage to the shell's totals */
+void usage_add(shell_state_t *state, const struct rusage *usage)
+{
+    struct rusage *total = &state->child_usage;
+
+    timeradd(&total->ru_utime, &usage->ru_utime, &total->ru_utime);
+    timeradd(&total->ru_stime, &usage->ru_stime, &total->ru_stime);
+    if (usage->ru_maxrss > total->ru_maxrss) {
+        total->ru_maxrss = usage->ru_maxrss;
+    }
+    total->ru_minflt += usage->ru_minflt;
+    total->ru_majflt += usage->ru_majflt;
+    total->ru_nvcsw += usage->ru_nvcsw;
+    total->ru_nivcsw += usage->ru_nivcsw;
+    state->children_reaped++;
+}
+
+/* Whole milliseconds in a timeval */
+static long timeval_ms(const struct timeval *tv)
+{
+    return tv->tv_sec * 1000 + tv->tv_usec / 1000;
+}
+
+/* Publish a foreground command's usage as $LAST_* */
+void usage_set_last(shell_state_t *state, const struct rusage *usage)
+{
+    char value[32];
+
+    snprintf(value, sizeof(value), "%ld", timeval_ms(&usage->ru_utime));
+    set_shell_var(state, "LAST_USER_MS", value);
+    snprintf(value, sizeof(value), "%ld", timeval_ms(&usage->ru_stime));
+    set_shell_var(state, "LAST_SYS_MS", value);
+    snprintf(value, sizeof(value), "%ld", usage->ru_maxrss);
+    set_shell_var(state, "LAST_RSS_KB", value);
+    snprintf(value, sizeof(value), "%ld", usage->ru_nvcsw + usage->ru_nivcsw);
+    set_shell_var(state, "LAST_CTXSW", value);
+}
+
+/* Print a duration as 0m0.000s */
+static void print_duration(FILE *fp, long sec, long usec)
+{
+    fprintf(fp, "%ldm%ld.%03lds", sec / 60, sec % 60, usec / 1000);
+}
+
+/* Print a job's usage as "user 0m0.000s sys 0m0.000s rss N KB" */
+void usage_print(FILE *fp, const struct rusage *usage)
+{
+    fprintf(fp, "user ");
+    print_duration(fp, usage->ru_utime.tv_sec, usage->ru_utime.tv_usec);
+    fprintf(fp, " sys ");
+    print_duration(fp, usage->ru_stime.tv_sec, usage->ru_stime.tv_usec);
+    fprintf(fp, " rss %ld KB", usage->ru_maxrss);
+}
+
+/* Built-in: times - CPU time of the shell and of its children */
+int builtin_times(command_t *cmd, shell_state_t *state)
+{
+    struct rusage self;
+    const struct rusage *children = &state->child_usage;
+
+    (void)cmd;
+    getrusage(RUSAGE_SELF, &self);
+
+    print_duration(state->out, self.ru_utime.tv_sec, self.ru_utime.tv_usec);
+    fputc(' ', state->out);
+    print_duration(state->out, self.ru_stime.tv_sec, self.ru_stime.tv_usec);
+    fputc('\n', state->out);
+    print_duration(state->out, children->ru_utime.tv_sec, children->ru_utime.tv_usec);
+    fputc(' ', state->out);
+    print_duration(state->out, children->ru_stime.tv_sec, children->ru_stime.tv_usec);
+    fputc('\n', state->out);
+
+    fprintf(state->out, "children: %ld reaped, max rss %ld KB, %ld voluntary and "
+        "%ld involuntary context switches\n", state->children_reaped,
+        children->ru_maxrss, children->ru_nvcsw, children->ru_nivcsw);
+    return 0;
+}
+
+/* time CHAIN: run the chain after the keyword and report to stderr the
+ * wall-clock time and the CPU time the shell and its children spent */
+int execute_timed(command_t *cmd, shell_state_t *state)
+{
+    struct timespec start, end;
+    struct rusage self_start, self_end;
+    struct rusage children_start = state->child_usage;
+    struct timeval user, sys, child;
+
+    /* Run from a copy without the keyword: the parse may be reused (a
+     * loop body, a cached line of a sourced file) */
+    command_t timed = *cmd;
+    timed.args = cmd->args + 1;
+    if (cmd->literal != NULL) timed.literal = cmd->literal + 1;
+
+    /* Substitutions index the arguments; shift them with the copy while
+     * it runs, and back for the next run of the parse */
+    for (procsub_t *ps = cmd->procsubs; ps != NULL; ps = ps->next) {
+        if (ps->redir == NULL) ps->arg_index--;
+    }
+
+    /* The report is printed after the chain, so it cannot replace us */
+    int exec_tail = state->exec_tail;
+    state->exec_tail = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    getrusage(RUSAGE_SELF, &self_start);
+
+    int result = execute_chain(&timed, state);
+
+    for (procsub_t *ps = cmd->procsubs; ps != NULL; ps = ps->next) {
+        if (ps->redir == NULL) ps->arg_index++;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &self_end);
+    state->exec_tail = exec_tail;
+
+    timersub(&self_end.ru_utime, &self_start.ru_utime, &user);
+    timersub(&state->child_usage.ru_utime, &children_start.ru_utime, &child);
+    timeradd(&user, &child, &user);
+    timersub(&self_end.ru_stime, &self_start.ru_stime, &sys);
+    timersub(&state->child_usage.ru_stime, &children_start.ru_stime, &child);
+    timeradd(&sys, &child, &sys);
+
+    long sec = end.tv_sec - start.tv_sec;
+    long nsec = end.tv_nsec - start.tv_nsec;
+    if (nsec < 0) {
+        sec--;
+        nsec += 1000000000L;
+    }
+
+    fflush(state->out);
+    fprintf(stderr, "\nreal\t");
+    print_duration(stderr, sec, nsec / 1000);
+    fprintf(stderr, "\nuser\t");
+    print_duration(stderr, user.tv_sec, user.tv_usec);
+    fprintf(stderr, "\nsys\t");
+    print_duration(stderr, sys.tv_sec, sys.tv_usec);
+    fprintf(stderr, "\n");
+    return result;
+}
\ No newline at end of file
@@ -98,3 +98,96 @@ char *trim_whitespace(char *str)
     *(end + 1) = '\0';
     return str;
 }
+
+
+/* Initialize an empty growable buffer */
+void buf_init(buffer_t *buf)
+{
+    buf->data = NULL;
+    buf->len = 0;
+    buf->cap = 0;
+}
+
+/* Make room for at least `extra` more bytes plus a terminating NUL */
+int buf_reserve(buffer_t *buf, size_t extra)
+{
+    if (buf->len + extra + 1 <= buf->cap) return 0;
+    
+    size_t new_cap = buf->cap ? buf->cap : 256;
+    while (new_cap < buf->len + extra + 1) {
+        new_cap *= 2;
+    }
+    
+    char *new_data = realloc(buf->data, new_cap);
+    if (new_data == NULL) return -1;
+    buf->data = new_data;
+    buf->cap = new_cap;
+    return 0;
+}
+
+/* Append `len` bytes to the buffer, keeping it NUL-terminated */
+int buf_append(buffer_t *buf, const char *s, size_t len)
+{
+    if (buf_reserve(buf, len) != 0) return -1;
+    memcpy(buf->data + buf->len, s, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+    return 0;
+}
+
+/* Hand the buffer contents to the caller as a C string */
+char *buf_release(buffer_t *buf)
+{
+    char *data = buf->data;
+    if (data == NULL) data = my_strdup("");
+    buf_init(buf);
+    return data;
+}
+
+/* Free buffer storage */
+void buf_free(buffer_t *buf)
+{
+    free(buf->data);
+    buf_init(buf);
+}
+
+/* 64-bit FNV-1a hash */
+uint64_t hash_bytes(const char *data, size_t len)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/* Move a descriptor the shell keeps open to 10 or above, close-on-exec,
+ * leaving 0-9 to scripts (exec 3>file). Returns the new descriptor, or
+ * fd itself if it cannot be moved */
+int move_fd_high(int fd)
+{
+    if (fd < 0 || fd >= USER_FD_LIMIT) return fd;
+
+    int moved = fcntl(fd, F_DUPFD_CLOEXEC, USER_FD_LIMIT);
+    if (moved < 0) return fd;
+    close(fd);
+    return moved;
+}
+/* Read one line of a script without its newline, as the interactive
+ * reader does (at most MAX_INPUT - 1 characters). NULL at EOF */
+char *read_script_line(FILE *fp)
+{
+    char buffer[MAX_INPUT];
+
+    if (fgets(buffer, MAX_INPUT, fp) == NULL) {
+        return NULL;
+    }
+
+    size_t len = strlen(buffer);
+    if (len > 0 && buffer[len - 1] == '\n') {
+        buffer[len - 1] = '\0';
+    }
+    return my_strdup(buffer);
+}
@@ -0,0 +1,80 @@
+/* src/vars.c - Shell variable store */
+
+#include "../include/shell.h"
+
+/* Find a variable slot by name */
+static shell_var_t *find_var(shell_state_t *state, const char *name)
+{
+    for (int i = 0; i < state->var_count; i++) {
+        if (strcmp(state->vars[i].name, name) == 0) {
+            return &state->vars[i];
+        }
+    }
+    return NULL;
+}
+
+/* Get a shell variable, or NULL if unset */
+const char *get_shell_var(shell_state_t *state, const char *name)
+{
+    shell_var_t *var = find_var(state, name);
+    return var ? var->value : NULL;
+}
+
+/* Set (or replace) a shell variable */
+int set_shell_var(shell_state_t *state, const char *name, const char *value)
+{
+    char *copy = my_strdup(value);
+    if (copy == NULL) return -1;
+
+    shell_var_t *var = find_var(state, name);
+    if (var != NULL) {
+        free(var->value);
+        var->value = copy;
+        return 0;
+    }
+
+    if (state->var_count >= state->var_capacity) {
+        int capacity = state->var_capacity ? state->var_capacity * 2 : 16;
+        shell_var_t *vars = realloc(state->vars, capacity * sizeof(shell_var_t));
+        if (vars == NULL) {
+            free(copy);
+            return -1;
+        }
+        state->vars = vars;
+        state->var_capacity = capacity;
+    }
+
+    var = &state->vars[state->var_count];
+    var->name = my_strdup(name);
+    if (var->name == NULL) {
+        free(copy);
+        return -1;
+    }
+    var->value = copy;
+    state->var_count++;
+    return 0;
+}
+
+/* Remove a shell variable */
+void unset_shell_var(shell_state_t *state, const char *name)
+{
+    shell_var_t *var = find_var(state, name);
+    if (var == NULL) return;
+
+    free(var->name);
+    free(var->value);
+    *var = state->vars[--state->var_count];
+}
+
+/* Free all shell variables */
+void free_shell_vars(shell_state_t *state)
+{
+    for (int i = 0; i < state->var_count; i++) {
+        free(state->vars[i].name);
+        free(state->vars[i].value);
+    }
+    free(state->vars);
+    state->vars = NULL;
+    state->var_count = 0;
+    state->var_capacity = 0;
+}
\ No newline at end of file
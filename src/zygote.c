@@ -0,0 +1,389 @@
+/* src/zygote.c - Pre-forked spawn helper
+ *
+ * The zygote is forked from the shell at startup, while the shell is
+ * still small, and forks commands on the shell's behalf. Spawning from
+ * it keeps fork cost independent of how large the shell has grown.
+ * Requests carry the program, cwd, argv and environment, with the
+ * command's stdin/stdout/stderr passed as SCM_RIGHTS descriptors; the
+ * zygote replies with the child's pid and later with its wait status.
+ */
+
+#include "../include/shell.h"
+#include <stdint.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+
+extern char **environ;
+
+/* Largest request (program, cwd, argv and environment) */
+#define ZYGOTE_MAX_REQUEST (256 * 1024)
+#define ZYGOTE_FD_COUNT 3
+
+/* Reply types */
+#define ZYGOTE_STARTED 1
+#define ZYGOTE_EXITED 2
+
+typedef struct zygote_msg_s {
+    int32_t type;
+    int32_t pid;
+    int32_t status;             /* Raw wait status for ZYGOTE_EXITED */
+    struct rusage usage;        /* What the child used (ZYGOTE_EXITED) */
+} zygote_msg_t;
+
+/* Child spawned through the zygote */
+typedef struct zygote_child_s {
+    pid_t pid;
+    int done;
+    int status;
+    struct rusage usage;
+} zygote_child_t;
+
+struct zygote_s {
+    int fd;                     /* Shell's end of the socketpair */
+    pid_t pid;
+    zygote_child_t *children;
+    int child_count;
+    int child_capacity;
+};
+
+/* Send a reply to the shell */
+static void zygote_reply(int sock, int type, pid_t pid, int status,
+    const struct rusage *usage)
+{
+    zygote_msg_t msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.type = type;
+    msg.pid = pid;
+    msg.status = status;
+    if (usage != NULL) msg.usage = *usage;
+    while (send(sock, &msg, sizeof(msg), 0) < 0 && errno == EINTR) {
+        /* retry */
+    }
+}
+
+/* Grandchild: wire up stdio, move to cwd and exec */
+static void zygote_exec(char *request, ssize_t len, int fds[ZYGOTE_FD_COUNT])
+{
+    int32_t argc;
+    int32_t envc;
+    memcpy(&argc, request, sizeof(argc));
+    memcpy(&envc, request + sizeof(argc), sizeof(envc));
+
+    char *pos = request + sizeof(argc) + sizeof(envc);
+    char *end = request + len;
+    char *path = pos;
+    pos += strlen(pos) + 1;
+    char *cwd = pos;
+    pos += strlen(pos) + 1;
+
+    char **argv = calloc(argc + 1, sizeof(char *));
+    char **envp = calloc(envc + 1, sizeof(char *));
+    if (argv == NULL || envp == NULL) _exit(1);
+    for (int i = 0; i < argc && pos < end; i++, pos += strlen(pos) + 1) {
+        argv[i] = pos;
+    }
+    for (int i = 0; i < envc && pos < end; i++, pos += strlen(pos) + 1) {
+        envp[i] = pos;
+    }
+
+    for (int i = 0; i < ZYGOTE_FD_COUNT; i++) {
+        if (dup2(fds[i], i) < 0) _exit(1);
+        close(fds[i]);
+    }
+
+    if (chdir(cwd) != 0) {
+        print_error();
+        _exit(1);
+    }
+
+    execve(path, argv, envp);
+    if (errno == EACCES) {
+        fprintf(stderr, "%s: permission denied\n", argv[0]);
+        _exit(126);
+    }
+    perror("execv");
+    _exit(1);
+}
+
+/* Zygote main loop: fork requested commands and report their exits */
+static void zygote_main(int sock)
+{
+    static char request[ZYGOTE_MAX_REQUEST];
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    int sigfd = signalfd(-1, &mask, SFD_CLOEXEC);
+    if (sigfd < 0) _exit(1);
+
+    struct pollfd pfds[2] = {
+        { sock, POLLIN, 0 },
+        { sigfd, POLLIN, 0 }
+    };
+
+    for (;;) {
+        if (poll(pfds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            _exit(1);
+        }
+
+        if (pfds[1].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            while (read(sigfd, &info, sizeof(info)) < 0 && errno == EINTR) {
+                /* retry */
+            }
+            int status;
+            pid_t pid;
+            struct rusage usage;
+            while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+                zygote_reply(sock, ZYGOTE_EXITED, pid, status, &usage);
+            }
+        }
+
+        if (pfds[0].revents & (POLLIN | POLLHUP)) {
+            int fds[ZYGOTE_FD_COUNT];
+            char control[CMSG_SPACE(sizeof(fds))];
+            struct iovec iov = { request, sizeof(request) };
+            struct msghdr msg;
+
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            ssize_t len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+            if (len == 0) _exit(0); /* Shell went away */
+            if (len < 0) {
+                if (errno == EINTR) continue;
+                _exit(1);
+            }
+
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS ||
+                cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+                zygote_reply(sock, ZYGOTE_STARTED, -1, 0, NULL);
+                continue;
+            }
+            memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+            pid_t pid = fork();
+            if (pid == 0) {
+                sigprocmask(SIG_UNBLOCK, &mask, NULL);
+                close(sock);
+                close(sigfd);
+                zygote_exec(request, len, fds);
+            }
+            for (int i = 0; i < ZYGOTE_FD_COUNT; i++) {
+                close(fds[i]);
+            }
+            zygote_reply(sock, ZYGOTE_STARTED, pid, 0, NULL);
+        }
+    }
+}
+
+/* Fork the zygote; call early, while the shell is small */
+int zygote_start(shell_state_t *state)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) != 0) {
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        zygote_main(sv[1]);
+    }
+    state->metrics.forks++;
+    close(sv[1]);
+
+    struct zygote_s *z = calloc(1, sizeof(struct zygote_s));
+    if (z == NULL) {
+        close(sv[0]);
+        return -1;
+    }
+
+    /* Keep the socket out of the way of user redirections */
+    z->fd = fcntl(sv[0], F_DUPFD_CLOEXEC, 10);
+    close(sv[0]);
+    z->pid = pid;
+    state->zygote = z;
+    return 0;
+}
+
+/* Remember the status and usage that arrived for a child */
+static void record_exit(struct zygote_s *z, const zygote_msg_t *msg)
+{
+    for (int i = 0; i < z->child_count; i++) {
+        if (z->children[i].pid == msg->pid) {
+            z->children[i].done = 1;
+            z->children[i].status = msg->status;
+            z->children[i].usage = msg->usage;
+            return;
+        }
+    }
+}
+
+/* Read one reply; returns -1 if none (nonblocking) or on error */
+static int read_reply(struct zygote_s *z, zygote_msg_t *msg, int nonblocking)
+{
+    for (;;) {
+        ssize_t n = recv(z->fd, msg, sizeof(*msg), nonblocking ? MSG_DONTWAIT : 0);
+        if (n == sizeof(*msg)) return 0;
+        if (n < 0 && errno == EINTR) continue;
+        return -1;
+    }
+}
+
+/* Spawn path with argv using the shell's current fds 0-2, cwd and
+ * environment; returns the child's pid or -1 */
+pid_t zygote_spawn(shell_state_t *state, const char *path, char **argv)
+{
+    struct zygote_s *z = state->zygote;
+    static char request[ZYGOTE_MAX_REQUEST];
+    int32_t argc = 0;
+    int32_t envc = 0;
+    size_t len = sizeof(argc) + sizeof(envc);
+
+    const char *fixed[2] = { path, state->cwd };
+    for (int i = 0; i < 2; i++) {
+        size_t n = strlen(fixed[i]) + 1;
+        if (len + n > sizeof(request)) return -1;
+        memcpy(request + len, fixed[i], n);
+        len += n;
+    }
+    for (char **arg = argv; *arg != NULL; arg++, argc++) {
+        size_t n = strlen(*arg) + 1;
+        if (len + n > sizeof(request)) return -1;
+        memcpy(request + len, *arg, n);
+        len += n;
+    }
+    for (char **env = environ; *env != NULL; env++, envc++) {
+        size_t n = strlen(*env) + 1;
+        if (len + n > sizeof(request)) return -1;
+        memcpy(request + len, *env, n);
+        len += n;
+    }
+    memcpy(request, &argc, sizeof(argc));
+    memcpy(request + sizeof(argc), &envc, sizeof(envc));
+
+    int fds[ZYGOTE_FD_COUNT] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = { request, len };
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(z->fd, &msg, 0) < 0) return -1;
+
+    /* Exit reports for earlier children may arrive first */
+    zygote_msg_t reply;
+    for (;;) {
+        if (read_reply(z, &reply, 0) != 0) return -1;
+        if (reply.type == ZYGOTE_STARTED) break;
+        record_exit(z, &reply);
+    }
+    if (reply.pid <= 0) return -1;
+
+    if (z->child_count >= z->child_capacity) {
+        int capacity = z->child_capacity ? z->child_capacity * 2 : 16;
+        zygote_child_t *grown = realloc(z->children, capacity * sizeof(zygote_child_t));
+        if (grown == NULL) return reply.pid;
+        z->children = grown;
+        z->child_capacity = capacity;
+    }
+    z->children[z->child_count].pid = reply.pid;
+    z->children[z->child_count].done = 0;
+    z->child_count++;
+
+    return reply.pid;
+}
+
+/* Was pid spawned through the zygote (and not yet waited for)? */
+int zygote_owns(shell_state_t *state, pid_t pid)
+{
+    struct zygote_s *z = state->zygote;
+    if (z == NULL) return 0;
+
+    for (int i = 0; i < z->child_count; i++) {
+        if (z->children[i].pid == pid) return 1;
+    }
+    return 0;
+}
+
+/* waitpid() for zygote children: returns pid once it has exited (with
+ * its wait4() usage), 0 if it is still running and WNOHANG was given,
+ * -1 on error */
+pid_t zygote_wait(shell_state_t *state, pid_t pid, int *status, int options,
+    struct rusage *usage)
+{
+    struct zygote_s *z = state->zygote;
+
+    for (;;) {
+        for (int i = 0; i < z->child_count; i++) {
+            if (z->children[i].pid == pid && z->children[i].done) {
+                if (status != NULL) *status = z->children[i].status;
+                if (usage != NULL) *usage = z->children[i].usage;
+                z->children[i] = z->children[--z->child_count];
+                return pid;
+            }
+        }
+
+        zygote_msg_t reply;
+        if (read_reply(z, &reply, options & WNOHANG) != 0) {
+            return (options & WNOHANG) && errno == EAGAIN ? 0 : -1;
+        }
+        if (reply.type == ZYGOTE_EXITED) {
+            record_exit(z, &reply);
+        }
+    }
+}
+
+/* Wait up to timeout_ms for the zygote to report an exit */
+void zygote_poll(shell_state_t *state, int timeout_ms)
+{
+    struct zygote_s *z = state->zygote;
+    struct pollfd pfd = { z->fd, POLLIN, 0 };
+    zygote_msg_t reply;
+
+    if (poll(&pfd, 1, timeout_ms) <= 0) return;
+
+    while (read_reply(z, &reply, 1) == 0) {
+        if (reply.type == ZYGOTE_EXITED) {
+            record_exit(z, &reply);
+        }
+    }
+}
+
+/* Shut the zygote down */
+void zygote_stop(shell_state_t *state)
+{
+    struct zygote_s *z = state->zygote;
+    if (z == NULL) return;
+
+    close(z->fd);
+    waitpid(z->pid, NULL, 0);
+    free(z->children);
+    free(z);
+    state->zygote = NULL;
+}
\ No newline at end of file